@@ -0,0 +1,382 @@
+#include "base_codec.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+
+#include "thread_pool.h"
+
+namespace base_codec {
+
+    namespace {
+        using namespace std::literals;
+
+        constexpr std::string_view COMPRESSED_MAGIC{ "TCLZ\0\0\0\1", 8 };
+        constexpr uint32_t MAX_SCALE_DIGITS = 9;
+
+        enum BlockMethod : char { STORED = 0, LZ = 1 };
+
+        uint64_t ZigZag(int64_t value) {
+            return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        }
+
+        int64_t UnZigZag(uint64_t value) {
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+
+        // Деление точного целого на точную степень десяти округляется к ближайшему
+        // double так же, как разбор десятичной записи, поэтому для координат
+        // с не более чем digits знаками после запятой преобразование без потерь
+        std::optional<int64_t> ToFixed(double value, double scale) {
+            const double scaled = std::round(value * scale);
+            if (!(std::abs(scaled) < 9e15)) {
+                return std::nullopt;
+            }
+            const auto fixed = static_cast<int64_t>(scaled);
+            if (static_cast<double>(fixed) / scale != value) {
+                return std::nullopt;
+            }
+            return fixed;
+        }
+
+        double Pow10(uint32_t digits) {
+            double scale = 1.0;
+            for (uint32_t i = 0; i < digits; ++i) {
+                scale *= 10.0;
+            }
+            return scale;
+        }
+
+        // Минимальная длина совпадения и размер хеш-таблицы поиска совпадений
+        constexpr size_t MIN_MATCH = 4;
+        constexpr size_t HASH_BITS = 14;
+
+        uint32_t Load32(const char* data) {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        uint32_t HashSequence(uint32_t sequence) {
+            return (sequence * 2654435761u) >> (32 - HASH_BITS);
+        }
+
+        // Блок - последовательность пар: длина литералов, литералы, длина
+        // совпадения сверх MIN_MATCH и смещение назад; последняя пара без совпадения
+        std::string CompressBlock(std::string_view block) {
+            std::string out;
+            out.reserve(block.size() / 2);
+            std::vector<uint32_t> table(size_t{ 1 } << HASH_BITS, UINT32_MAX);
+            size_t literal_begin = 0;
+            size_t pos = 0;
+            while (pos + MIN_MATCH <= block.size()) {
+                const uint32_t sequence = Load32(block.data() + pos);
+                uint32_t& slot = table[HashSequence(sequence)];
+                const uint32_t candidate = slot;
+                slot = static_cast<uint32_t>(pos);
+                if (candidate == UINT32_MAX || Load32(block.data() + candidate) != sequence) {
+                    ++pos;
+                    continue;
+                }
+                size_t length = MIN_MATCH;
+                while (pos + length < block.size() && block[candidate + length] == block[pos + length]) {
+                    ++length;
+                }
+                WriteVarint(out, pos - literal_begin);
+                out.append(block.substr(literal_begin, pos - literal_begin));
+                WriteVarint(out, length - MIN_MATCH + 1);
+                WriteVarint(out, pos - candidate);
+                pos += length;
+                literal_begin = pos;
+            }
+            WriteVarint(out, block.size() - literal_begin);
+            out.append(block.substr(literal_begin));
+            WriteVarint(out, 0);
+            return out;
+        }
+
+        void AppendCompressedBlock(std::string& out, std::string_view block) {
+            std::string compressed = CompressBlock(block);
+            const bool stored = compressed.size() >= block.size();
+            WriteVarint(out, block.size());
+            WriteVarint(out, stored ? block.size() : compressed.size());
+            out.push_back(stored ? STORED : LZ);
+            out.append(stored ? block : std::string_view(compressed));
+        }
+
+        // Распаковывает блок в out[0, raw_size)
+        void DecompressBlock(std::string_view block, size_t raw_size, char* out) {
+            size_t written = 0;
+            size_t pos = 0;
+            while (true) {
+                const uint64_t literals = ReadVarint(block, pos);
+                if (literals > block.size() - pos || written + literals > raw_size) {
+                    throw std::runtime_error("Corrupted compressed block"s);
+                }
+                std::memcpy(out + written, block.data() + pos, literals);
+                written += literals;
+                pos += literals;
+                const uint64_t match = ReadVarint(block, pos);
+                if (match == 0) {
+                    break;
+                }
+                const uint64_t length = match - 1 + MIN_MATCH;
+                const uint64_t offset = ReadVarint(block, pos);
+                if (offset == 0 || offset > written || written + length > raw_size) {
+                    throw std::runtime_error("Corrupted compressed block"s);
+                }
+                // Совпадение может перекрывать само себя, поэтому копируем побайтно
+                for (uint64_t i = 0; i < length; ++i, ++written) {
+                    out[written] = out[written - offset];
+                }
+            }
+            if (written != raw_size) {
+                throw std::runtime_error("Corrupted compressed block"s);
+            }
+        }
+    } // namespace
+
+    void WriteVarint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    uint64_t ReadVarint(std::string_view data, size_t& pos) {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= data.size()) {
+                throw std::runtime_error("Unexpected end of varint"s);
+            }
+            const auto byte = static_cast<unsigned char>(data[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (byte < 0x80) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Varint is too long"s);
+    }
+
+    EncodedCoordinates EncodeCoordinates(const std::vector<geo::Coordinates>& coordinates) {
+        // Приращения берутся в порядке номеров остановок, без сортировки
+        EncodedCoordinates encoded;
+        for (uint32_t digits = 0; digits <= MAX_SCALE_DIGITS; ++digits) {
+            const double scale = Pow10(digits);
+            std::string deltas;
+            int64_t prev_lat = 0;
+            int64_t prev_lng = 0;
+            bool exact = true;
+            for (const auto& point : coordinates) {
+                const auto lat = ToFixed(point.lat, scale);
+                const auto lng = ToFixed(point.lng, scale);
+                if (!lat || !lng) {
+                    exact = false;
+                    break;
+                }
+                WriteVarint(deltas, ZigZag(*lat - prev_lat));
+                WriteVarint(deltas, ZigZag(*lng - prev_lng));
+                prev_lat = *lat;
+                prev_lng = *lng;
+            }
+            if (exact) {
+                encoded.scale_digits = digits;
+                encoded.deltas = std::move(deltas);
+                return encoded;
+            }
+        }
+        encoded.raw.reserve(coordinates.size() * 2);
+        for (const auto& point : coordinates) {
+            encoded.raw.push_back(point.lat);
+            encoded.raw.push_back(point.lng);
+        }
+        return encoded;
+    }
+
+    std::vector<geo::Coordinates> DecodeCoordinates(const EncodedCoordinates& encoded, size_t count) {
+        std::vector<geo::Coordinates> coordinates;
+        coordinates.reserve(count);
+        if (!encoded.scale_digits) {
+            if (encoded.raw.size() != count * 2) {
+                throw std::runtime_error("Corrupted coordinates column"s);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                coordinates.push_back({ encoded.raw[2 * i], encoded.raw[2 * i + 1] });
+            }
+            return coordinates;
+        }
+        const double scale = Pow10(std::min(*encoded.scale_digits, MAX_SCALE_DIGITS));
+        size_t pos = 0;
+        int64_t lat = 0;
+        int64_t lng = 0;
+        for (size_t i = 0; i < count; ++i) {
+            lat += UnZigZag(ReadVarint(encoded.deltas, pos));
+            lng += UnZigZag(ReadVarint(encoded.deltas, pos));
+            coordinates.push_back({ static_cast<double>(lat) / scale, static_cast<double>(lng) / scale });
+        }
+        return coordinates;
+    }
+
+    std::string EncodeDistances(const std::vector<Distance>& distances) {
+        std::string encoded;
+        WriteVarint(encoded, distances.size());
+        uint32_t prev_from = 0;
+        uint32_t prev_to = 0;
+        for (const auto& [from, to, distance] : distances) {
+            if (from < prev_from || (from == prev_from && to < prev_to)) {
+                throw std::logic_error("Distances must be sorted before encoding"s);
+            }
+            WriteVarint(encoded, from - prev_from);
+            WriteVarint(encoded, from == prev_from ? to - prev_to : to);
+            WriteVarint(encoded, distance);
+            prev_from = from;
+            prev_to = to;
+        }
+        return encoded;
+    }
+
+    std::vector<Distance> DecodeDistances(std::string_view encoded) {
+        size_t pos = 0;
+        const uint64_t count = ReadVarint(encoded, pos);
+        if (count > encoded.size()) {
+            throw std::runtime_error("Corrupted distances column"s);
+        }
+        std::vector<Distance> distances;
+        distances.reserve(count);
+        uint64_t from = 0;
+        uint64_t to = 0;
+        for (uint64_t i = 0; i < count; ++i) {
+            const uint64_t from_delta = ReadVarint(encoded, pos);
+            const uint64_t to_value = ReadVarint(encoded, pos);
+            to = from_delta == 0 && i > 0 ? to + to_value : to_value;
+            from += from_delta;
+            if (from > UINT32_MAX || to > UINT32_MAX) {
+                throw std::runtime_error("Corrupted distances column"s);
+            }
+            distances.emplace_back(static_cast<uint32_t>(from), static_cast<uint32_t>(to), ReadVarint(encoded, pos));
+        }
+        return distances;
+    }
+
+    uint64_t Fingerprint(std::string_view data, uint64_t hash) {
+        for (const char c : data) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool IsCompressed(std::string_view data) {
+        return data.substr(0, COMPRESSED_MAGIC.size()) == COMPRESSED_MAGIC;
+    }
+
+    CompressedReader::CompressedReader(std::string data)
+        : data_(std::move(data)) {
+        const std::string_view view = data_;
+        if (!IsCompressed(view)) {
+            throw std::runtime_error("Data is not compressed"s);
+        }
+        // Заголовки блоков читаются по порядку, а сами блоки независимы
+        size_t pos = COMPRESSED_MAGIC.size();
+        while (pos < view.size()) {
+            const uint64_t raw_size = ReadVarint(view, pos);
+            const uint64_t stored_size = ReadVarint(view, pos);
+            if (raw_size > COMPRESSION_BLOCK_SIZE || pos >= view.size() || stored_size > view.size() - pos - 1) {
+                throw std::runtime_error("Corrupted compressed base"s);
+            }
+            const char method = view[pos++];
+            if (!(method == STORED && stored_size == raw_size) && method != LZ) {
+                throw std::runtime_error("Corrupted compressed base"s);
+            }
+            if (!blocks_.empty() && blocks_.back().raw_size != COMPRESSION_BLOCK_SIZE) {
+                throw std::runtime_error("Corrupted compressed base"s);
+            }
+            blocks_.push_back({ view.substr(pos, stored_size), raw_size, raw_size_, method });
+            raw_size_ += raw_size;
+            pos += stored_size;
+        }
+    }
+
+    uint64_t CompressedReader::GetRawSize() const {
+        return raw_size_;
+    }
+
+    std::string CompressedReader::ReadRanges(const std::vector<Range>& ranges) const {
+        // Блок i хранит данные [raw_offset, raw_offset + raw_size); все блоки,
+        // кроме последнего, полные, поэтому номер блока - смещение / размер блока
+        std::vector<size_t> needed;
+        size_t total = 0;
+        for (const auto& [offset, size] : ranges) {
+            if (offset > raw_size_ || size > raw_size_ - offset) {
+                throw std::runtime_error("Range is out of compressed data"s);
+            }
+            total += size;
+            if (size == 0) {
+                continue;
+            }
+            for (size_t i = offset / COMPRESSION_BLOCK_SIZE; i <= (offset + size - 1) / COMPRESSION_BLOCK_SIZE; ++i) {
+                needed.push_back(i);
+            }
+        }
+        std::sort(needed.begin(), needed.end());
+        needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+
+        std::vector<std::string> raw_blocks(blocks_.size());
+        thread_pool::ParallelFor(needed.size(), [this, &needed, &raw_blocks](size_t i) {
+            const Block& block = blocks_[needed[i]];
+            std::string& raw = raw_blocks[needed[i]];
+            if (block.method == STORED) {
+                raw.assign(block.stored);
+            }
+            else {
+                raw.resize(block.raw_size);
+                DecompressBlock(block.stored, block.raw_size, raw.data());
+            }
+        });
+
+        std::string out;
+        out.reserve(total);
+        for (auto [offset, size] : ranges) {
+            while (size > 0) {
+                const size_t index = offset / COMPRESSION_BLOCK_SIZE;
+                const size_t in_block = offset - blocks_[index].raw_offset;
+                const size_t part = std::min<uint64_t>(size, blocks_[index].raw_size - in_block);
+                out.append(raw_blocks[index], in_block, part);
+                offset += part;
+                size -= part;
+            }
+        }
+        return out;
+    }
+
+    CompressedWriter::CompressedWriter(std::ostream& out)
+        : out_(out) {
+        out_.write(COMPRESSED_MAGIC.data(), static_cast<std::streamsize>(COMPRESSED_MAGIC.size()));
+        block_.reserve(COMPRESSION_BLOCK_SIZE);
+    }
+
+    void CompressedWriter::Write(std::string_view data) {
+        while (!data.empty()) {
+            const size_t part = std::min(data.size(), COMPRESSION_BLOCK_SIZE - block_.size());
+            block_.append(data.substr(0, part));
+            data.remove_prefix(part);
+            if (block_.size() == COMPRESSION_BLOCK_SIZE) {
+                Finish();
+            }
+        }
+    }
+
+    void CompressedWriter::Finish() {
+        if (block_.empty()) {
+            return;
+        }
+        std::string out;
+        AppendCompressedBlock(out, block_);
+        out_.write(out.data(), static_cast<std::streamsize>(out.size()));
+        block_.clear();
+    }
+
+} // namespace base_codec
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "geo.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace base_codec {
+
+    // Плотные кодировки столбцов базы и блочное LZ-сжатие без внешних
+    // зависимостей. Ошибки разбора повреждённых данных - std::runtime_error.
+
+    void WriteVarint(std::string& out, uint64_t value);
+    uint64_t ReadVarint(std::string_view data, size_t& pos);
+
+    // Координаты в порядке номеров остановок. Если все они точно
+    // представимы как целые в 10^-k градуса, пишутся приращения к соседу
+    // в фиксированной точке (zigzag-varint), иначе - исходные double.
+    // Координаты не сортируются и перестановка не хранится: приращения малы,
+    // только если соседние номера близки на карте, что даёт нумерация
+    // stop_order "hilbert" или "rcm"; при "input" - как повезёт с входом
+    struct EncodedCoordinates {
+        // Число знаков после запятой; nullopt - координаты лежат в raw
+        std::optional<uint32_t> scale_digits;
+        std::string deltas;
+        std::vector<double> raw;
+    };
+
+    EncodedCoordinates EncodeCoordinates(const std::vector<geo::Coordinates>& coordinates);
+    std::vector<geo::Coordinates> DecodeCoordinates(const EncodedCoordinates& encoded, size_t count);
+
+    // Расстояния (from, to, метры), упорядоченные по (from, to): приращение from,
+    // затем to как приращение к предыдущему to той же остановки и длина, всё varint
+    using Distance = std::tuple<uint32_t, uint32_t, uint64_t>;
+
+    std::string EncodeDistances(const std::vector<Distance>& distances);
+    std::vector<Distance> DecodeDistances(std::string_view encoded);
+
+    // FNV-1a над данными: по нему дельта узнаёт базу, от которой построена.
+    // Отпечаток склеенных кусков - Fingerprint(второй, Fingerprint(первый))
+    constexpr uint64_t FINGERPRINT_BASIS = 14695981039346656037ull;
+    uint64_t Fingerprint(std::string_view data, uint64_t hash = FINGERPRINT_BASIS);
+
+    // Сжатый контейнер: заголовок, затем независимые блоки по COMPRESSION_BLOCK_SIZE
+    // исходных байт, каждый сжат LZ77 или сохранён как есть, если сжатие не помогло
+    constexpr size_t COMPRESSION_BLOCK_SIZE = 64 * 1024;
+
+    bool IsCompressed(std::string_view data);
+
+    // Потоковое сжатие: в памяти держится не больше одного блока
+    class CompressedWriter {
+    public:
+        // Сразу пишет заголовок в out
+        explicit CompressedWriter(std::ostream& out);
+
+        void Write(std::string_view data);
+        // Дописывает неполный последний блок
+        void Finish();
+
+    private:
+        std::ostream& out_;
+        std::string block_;
+    };
+
+    // Чтение сжатого контейнера по частям: распаковываются только блоки,
+    // пересекающие запрошенные диапазоны несжатых данных
+    class CompressedReader {
+    public:
+        // Диапазон несжатых данных: смещение и длина
+        using Range = std::pair<uint64_t, uint64_t>;
+
+        explicit CompressedReader(std::string data);
+
+        uint64_t GetRawSize() const;
+        // Склеенное по порядку содержимое диапазонов; нужные блоки
+        // распаковываются параллельно
+        std::string ReadRanges(const std::vector<Range>& ranges) const;
+
+    private:
+        struct Block {
+            std::string_view stored;
+            size_t raw_size;
+            uint64_t raw_offset;
+            char method;
+        };
+
+        std::string data_;
+        std::vector<Block> blocks_;
+        uint64_t raw_size_ = 0;
+    };
+
+} // namespace base_codec
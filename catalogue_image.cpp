@@ -0,0 +1,408 @@
+#include "catalogue_image.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace catalogue_image {
+
+    namespace {
+        using namespace std::literals;
+
+        constexpr std::array<char, 8> MAGIC{ 'T', 'C', 'I', 'M', 'A', 'G', 'E', '\0' };
+        constexpr uint32_t VERSION = 1;
+        constexpr size_t ALIGNMENT = 8;
+
+        enum SectionId : uint32_t {
+            STRINGS, STOPS, STOP_INDEX, STOP_BUSES, BUSES, BUS_INDEX, BUS_STOPS,
+            DISTANCES, ROUTING_SETTINGS, MAP_RENDER, EDGES, ROUTES, SECTION_COUNT
+        };
+
+        struct FileHeader {
+            std::array<char, 8> magic;
+            uint32_t version;
+            uint32_t section_count;
+        };
+
+        struct SectionEntry {
+            uint32_t id;
+            uint32_t reserved;
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        static_assert(std::is_trivially_copyable_v<StopRecord> && sizeof(StopRecord) % ALIGNMENT == 0);
+        static_assert(std::is_trivially_copyable_v<BusRecord> && sizeof(BusRecord) % ALIGNMENT == 0);
+        static_assert(std::is_trivially_copyable_v<EdgeRecord> && sizeof(EdgeRecord) % ALIGNMENT == 0);
+        static_assert(std::is_trivially_copyable_v<RouteRecord> && sizeof(RouteRecord) % ALIGNMENT == 0);
+        static_assert(sizeof(FileHeader) % ALIGNMENT == 0 && sizeof(SectionEntry) % ALIGNMENT == 0);
+
+        template <typename Record>
+        void Append(std::string& section, const Record& record) {
+            section.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+
+        uint32_t ToIndex(size_t value) {
+            if (value > UINT32_MAX) {
+                throw std::length_error("Catalogue is too large for the image format"s);
+            }
+            return static_cast<uint32_t>(value);
+        }
+
+        class SectionWriter {
+        public:
+            std::string& operator[](SectionId id) {
+                return sections_[id];
+            }
+
+            uint32_t AddString(std::string_view str) {
+                std::string& strings = sections_[STRINGS];
+                const uint32_t offset = ToIndex(strings.size());
+                ToIndex(strings.size() + str.size());
+                strings.append(str);
+                return offset;
+            }
+
+            void Write(const std::filesystem::path& path) const {
+                const auto align = [](uint64_t offset) {
+                    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+                };
+
+                std::array<SectionEntry, SECTION_COUNT> table{};
+                uint64_t offset = sizeof(FileHeader) + sizeof(table);
+                for (uint32_t id = 0; id < SECTION_COUNT; ++id) {
+                    offset = align(offset);
+                    table[id] = SectionEntry{ id, 0, offset, sections_[id].size() };
+                    offset += sections_[id].size();
+                }
+
+                // Образ заменяется переименованием: уже отображённый старый файл
+                // остаётся целым у процессов, которые им пользуются
+                const std::filesystem::path temp_path = path.string() + ".tmp";
+                std::ofstream out(temp_path, std::ios::binary);
+                const FileHeader header{ MAGIC, VERSION, SECTION_COUNT };
+                out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                out.write(reinterpret_cast<const char*>(table.data()), sizeof(table));
+                uint64_t written = sizeof(FileHeader) + sizeof(table);
+                for (uint32_t id = 0; id < SECTION_COUNT; ++id) {
+                    const std::string padding(table[id].offset - written, '\0');
+                    out.write(padding.data(), padding.size());
+                    out.write(sections_[id].data(), sections_[id].size());
+                    written = table[id].offset + sections_[id].size();
+                }
+                out.close();
+                if (!out) {
+                    throw std::runtime_error("Failed to write catalogue image "s + path.string());
+                }
+                std::filesystem::rename(temp_path, path);
+            }
+
+        private:
+            std::array<std::string, SECTION_COUNT> sections_;
+        };
+
+        // Идентификаторы в порядке возрастания названий - индекс для двоичного поиска
+        template <typename Names>
+        void AppendNameIndex(std::string& section, const Names& names) {
+            std::vector<uint32_t> ids(names.size());
+            for (uint32_t id = 0; id < ids.size(); ++id) {
+                ids[id] = id;
+            }
+            std::sort(ids.begin(), ids.end(), [&names](uint32_t lhs, uint32_t rhs) {
+                return names[lhs] < names[rhs];
+            });
+            for (const uint32_t id : ids) {
+                Append(section, id);
+            }
+        }
+    } // namespace
+
+    void WriteImage(const std::filesystem::path& path, transport_db::TransportCatalogue& catalogue,
+        const transport_router::TransportRouter& transport_router, const graph::Router<double>& router,
+        std::string_view map_render) {
+        const auto& stops = catalogue.GetAllStops();
+        const auto& buses = catalogue.GetAllBuses();
+
+        std::vector<std::string_view> stop_names;
+        stop_names.reserve(stops.size());
+        for (const auto& stop : stops) {
+            stop_names.push_back(stop.name);
+        }
+        std::vector<std::string_view> bus_names;
+        std::unordered_map<std::string_view, uint32_t> bus_ids;
+        bus_names.reserve(buses.size());
+        for (const auto& bus : buses) {
+            bus_ids.emplace(bus.bus_number, ToIndex(bus_names.size()));
+            bus_names.push_back(bus.bus_number);
+        }
+
+        SectionWriter sections;
+        for (const auto& stop : stops) {
+            const std::vector<std::string> stop_buses = catalogue.GetStopInfo(stop.name).bus_number_;
+            const StopRecord record{ stop.coords.lat, stop.coords.lng,
+                sections.AddString(stop.name), ToIndex(stop.name.size()),
+                ToIndex(sections[STOP_BUSES].size() / sizeof(uint32_t)), ToIndex(stop_buses.size()) };
+            for (const auto& bus : stop_buses) {
+                Append(sections[STOP_BUSES], bus_ids.at(bus));
+            }
+            Append(sections[STOPS], record);
+        }
+        AppendNameIndex(sections[STOP_INDEX], stop_names);
+
+        for (const auto& bus : buses) {
+            const transport_db::BusInfo info = catalogue.GetBusInfo(bus.bus_number);
+            const BusRecord record{ sections.AddString(bus.bus_number), ToIndex(bus.bus_number.size()),
+                ToIndex(sections[BUS_STOPS].size() / sizeof(uint32_t)), ToIndex(bus.stops.size()),
+                info.stops_count_, info.unique_stops_, info.meters_route_length_, bus.is_roundtrip ? 1u : 0u,
+                info.geo_route_length_, info.curvature_ };
+            for (const domain::Stop* stop : bus.stops) {
+                Append(sections[BUS_STOPS], ToIndex(stop->edge_id));
+            }
+            Append(sections[BUSES], record);
+        }
+        AppendNameIndex(sections[BUS_INDEX], bus_names);
+
+        std::vector<DistanceRecord> distances;
+        for (const auto& [from_to, distance] : catalogue.GetStopsFromTo()) {
+            distances.push_back({ ToIndex(from_to.first->edge_id), ToIndex(from_to.second->edge_id), distance });
+        }
+        std::sort(distances.begin(), distances.end(), [](const DistanceRecord& lhs, const DistanceRecord& rhs) {
+            return std::pair(lhs.from, lhs.to) < std::pair(rhs.from, rhs.to);
+        });
+        for (const auto& distance : distances) {
+            Append(sections[DISTANCES], distance);
+        }
+
+        Append(sections[ROUTING_SETTINGS], RoutingSettingsRecord{ transport_router.GetVelocity(), transport_router.GetWaitTime(), 0 });
+        sections[MAP_RENDER].assign(map_render);
+
+        const auto& graph = router.GetGraph();
+        for (graph::EdgeId id = 0; id < graph.GetEdgeCount(); ++id) {
+            const auto& edge = graph.GetEdge(id);
+            Append(sections[EDGES], EdgeRecord{ ToIndex(edge.from), ToIndex(edge.to),
+                ToIndex(edge.span_count), bus_ids.at(edge.bus), edge.weight });
+        }
+
+        const size_t vertex_count = graph.GetVertexCount();
+        sections[ROUTES].reserve(vertex_count * vertex_count * sizeof(RouteRecord));
+        for (graph::VertexId from = 0; from < vertex_count; ++from) {
+            for (graph::VertexId to = 0; to < vertex_count; ++to) {
+                RouteRecord record{ 0.0, RouteRecord::NO_EDGE, 0 };
+                if (const auto& route = router.GetRouteInternalData(from, to)) {
+                    record.weight = route->weight;
+                    record.prev_edge = route->prev_edge ? ToIndex(*route->prev_edge) : RouteRecord::NO_EDGE;
+                    record.reachable = 1;
+                }
+                Append(sections[ROUTES], record);
+            }
+        }
+
+        sections.Write(path);
+    }
+
+    bool IsImageFile(const std::filesystem::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        std::array<char, MAGIC.size()> magic{};
+        return in.read(magic.data(), magic.size()) && magic == MAGIC;
+    }
+
+#ifndef _WIN32
+    Image::Image(const std::filesystem::path& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open catalogue image "s + path.string() + ": "s + std::strerror(errno));
+        }
+        struct stat file_stat {};
+        if (fstat(fd, &file_stat) < 0 || file_stat.st_size == 0) {
+            close(fd);
+            throw std::runtime_error("Catalogue image is empty: "s + path.string());
+        }
+        size_ = static_cast<size_t>(file_stat.st_size);
+        // Разделяемое отображение: страницы образа общие для всех процессов
+        mapping_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping_ == MAP_FAILED) {
+            mapping_ = nullptr;
+            throw std::runtime_error("Failed to map catalogue image "s + path.string() + ": "s + std::strerror(errno));
+        }
+        data_ = static_cast<const char*>(mapping_);
+        try {
+            LoadSections();
+        }
+        catch (...) {
+            Unmap();
+            throw;
+        }
+    }
+
+    void Image::Unmap() {
+        if (mapping_ != nullptr) {
+            munmap(mapping_, size_);
+            mapping_ = nullptr;
+        }
+    }
+#else
+    Image::Image(const std::filesystem::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("Failed to open catalogue image "s + path.string());
+        }
+        buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+        LoadSections();
+    }
+
+    void Image::Unmap() {
+    }
+#endif
+
+    Image::~Image() {
+        Unmap();
+    }
+
+    // Проверяется только структура файла: образ пишет make_base, и записи внутри
+    // разделов не перебираются, чтобы открытие не зависело от размера справочника
+    void Image::LoadSections() {
+        FileHeader header{};
+        if (size_ < sizeof(header) + SECTION_COUNT * sizeof(SectionEntry)) {
+            throw std::runtime_error("Catalogue image is truncated"s);
+        }
+        std::memcpy(&header, data_, sizeof(header));
+        if (header.magic != MAGIC) {
+            throw std::runtime_error("Not a catalogue image"s);
+        }
+        if (header.version != VERSION || header.section_count != SECTION_COUNT) {
+            throw std::runtime_error("Unsupported catalogue image version"s);
+        }
+
+        strings_ = GetSection<char>(STRINGS);
+        stops_ = GetSection<StopRecord>(STOPS);
+        stop_index_ = GetSection<uint32_t>(STOP_INDEX);
+        stop_buses_ = GetSection<uint32_t>(STOP_BUSES);
+        buses_ = GetSection<BusRecord>(BUSES);
+        bus_index_ = GetSection<uint32_t>(BUS_INDEX);
+        bus_stops_ = GetSection<uint32_t>(BUS_STOPS);
+        distances_ = GetSection<DistanceRecord>(DISTANCES);
+        routing_settings_ = GetSection<RoutingSettingsRecord>(ROUTING_SETTINGS);
+        map_render_ = GetSection<char>(MAP_RENDER);
+        edges_ = GetSection<EdgeRecord>(EDGES);
+        routes_ = GetSection<RouteRecord>(ROUTES);
+
+        if (stop_index_.size != stops_.size || bus_index_.size != buses_.size
+            || routing_settings_.size != 1 || routes_.size != stops_.size * stops_.size) {
+            throw std::runtime_error("Catalogue image is corrupted"s);
+        }
+    }
+
+    template <typename Record>
+    Image::Section<Record> Image::GetSection(uint32_t id) const {
+        SectionEntry entry{};
+        std::memcpy(&entry, data_ + sizeof(FileHeader) + id * sizeof(SectionEntry), sizeof(entry));
+        if (entry.id != id || entry.offset % ALIGNMENT != 0 || entry.offset > size_
+            || entry.size > size_ - entry.offset || entry.size % sizeof(Record) != 0) {
+            throw std::runtime_error("Catalogue image is corrupted"s);
+        }
+        return { reinterpret_cast<const Record*>(data_ + entry.offset), entry.size / sizeof(Record) };
+    }
+
+    std::string_view Image::GetString(uint32_t offset, uint32_t size) const {
+        return { strings_.data + offset, size };
+    }
+
+    template <typename Record>
+    std::optional<uint32_t> Image::FindByName(const Section<uint32_t>& index, const Section<Record>& records, std::string_view name) const {
+        const auto record_name = [&](uint32_t id) {
+            return GetString(records.data[id].name_offset, records.data[id].name_size);
+        };
+        const uint32_t* it = std::lower_bound(index.data, index.data + index.size, name, [&](uint32_t id, std::string_view value) {
+            return record_name(id) < value;
+        });
+        if (it == index.data + index.size || record_name(*it) != name) {
+            return std::nullopt;
+        }
+        return *it;
+    }
+
+    std::optional<uint32_t> Image::FindStop(std::string_view name) const {
+        return FindByName(stop_index_, stops_, name);
+    }
+
+    std::optional<uint32_t> Image::FindBus(std::string_view name) const {
+        return FindByName(bus_index_, buses_, name);
+    }
+
+    std::string_view Image::GetStopName(uint32_t stop) const {
+        return GetString(stops_.data[stop].name_offset, stops_.data[stop].name_size);
+    }
+
+    std::string_view Image::GetBusName(uint32_t bus) const {
+        return GetString(buses_.data[bus].name_offset, buses_.data[bus].name_size);
+    }
+
+    Image::Ids Image::GetStopBuses(uint32_t stop) const {
+        const uint32_t* begin = stop_buses_.data + stops_.data[stop].buses_begin;
+        return { begin, begin + stops_.data[stop].buses_count };
+    }
+
+    std::optional<transport_db::BusInfo> Image::GetBusInfo(std::string_view name) const {
+        const auto bus = FindBus(name);
+        if (!bus) {
+            return std::nullopt;
+        }
+        const BusRecord& record = buses_.data[*bus];
+        transport_db::BusInfo info;
+        info.bus_number_ = name;
+        info.stops_count_ = record.stop_count;
+        info.unique_stops_ = record.unique_stop_count;
+        info.geo_route_length_ = record.geo_route_length;
+        info.meters_route_length_ = record.route_length;
+        info.curvature_ = record.curvature;
+        return info;
+    }
+
+    int Image::GetBusWaitTime() const {
+        return routing_settings_.data->bus_wait_time;
+    }
+
+    double Image::GetBusVelocity() const {
+        return routing_settings_.data->bus_velocity;
+    }
+
+    std::string_view Image::GetMapRender() const {
+        return { map_render_.data, map_render_.size };
+    }
+
+    const EdgeRecord& Image::GetEdge(uint32_t edge) const {
+        return edges_.data[edge];
+    }
+
+    // Восстанавливает путь по таблице так же, как graph::Router::BuildRoute
+    std::optional<Image::RouteInfo> Image::BuildRoute(uint32_t from, uint32_t to) const {
+        const RouteRecord* from_routes = routes_.data + static_cast<size_t>(from) * stops_.size;
+        if (!from_routes[to].reachable) {
+            return std::nullopt;
+        }
+        RouteInfo info{ from_routes[to].weight, {} };
+        for (uint32_t edge = from_routes[to].prev_edge; edge != RouteRecord::NO_EDGE; edge = from_routes[edges_.data[edge].from].prev_edge) {
+            info.edges.push_back(edge);
+        }
+        std::reverse(info.edges.begin(), info.edges.end());
+        return info;
+    }
+
+} // namespace catalogue_image
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "transport_catalogue.h"
+#include "transport_router.h"
+#include "router.h"
+#include "ranges.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace catalogue_image {
+
+    // Образ справочника для отображения в память несколькими процессами.
+    // Все ссылки внутри образа - индексы и смещения от начала файла, поэтому
+    // образ не зависит от адреса, по которому он отображён, и используется
+    // без разбора: страницы файла общие для всех процессов через кэш ОС.
+    //
+    // Файл: заголовок, таблица разделов, затем разделы, выровненные на 8 байт.
+
+    struct StopRecord {
+        double lat;
+        double lng;
+        uint32_t name_offset;
+        uint32_t name_size;
+        // Автобусы через остановку, упорядоченные по названию (раздел STOP_BUSES)
+        uint32_t buses_begin;
+        uint32_t buses_count;
+    };
+
+    struct BusRecord {
+        uint32_t name_offset;
+        uint32_t name_size;
+        uint32_t stops_begin;
+        uint32_t stops_count;
+        // Предвычисленная статистика маршрута, как в TransportCatalogue::GetBusInfo
+        int32_t stop_count;
+        int32_t unique_stop_count;
+        int32_t route_length;
+        uint32_t is_roundtrip;
+        double geo_route_length;
+        double curvature;
+    };
+
+    struct DistanceRecord {
+        uint32_t from;
+        uint32_t to;
+        uint64_t distance;
+    };
+
+    struct EdgeRecord {
+        uint32_t from;
+        uint32_t to;
+        uint32_t span_count;
+        uint32_t bus;
+        double weight;
+    };
+
+    // Элемент матрицы маршрутизатора: вес кратчайшего пути и последнее ребро
+    struct RouteRecord {
+        static constexpr uint32_t NO_EDGE = UINT32_MAX;
+
+        double weight;
+        uint32_t prev_edge;
+        uint32_t reachable;
+    };
+
+    struct RoutingSettingsRecord {
+        double bus_velocity;
+        int32_t bus_wait_time;
+        uint32_t reserved;
+    };
+
+    // Записывает образ: справочник, индексы по названиям, карту и таблицы маршрутизатора
+    void WriteImage(const std::filesystem::path& path, transport_db::TransportCatalogue& catalogue,
+        const transport_router::TransportRouter& transport_router, const graph::Router<double>& router,
+        std::string_view map_render);
+
+    // Начинается ли файл с заголовка образа; читает только первые байты
+    bool IsImageFile(const std::filesystem::path& path);
+
+    class Image {
+    public:
+        using Ids = ranges::Range<const uint32_t*>;
+
+        struct RouteInfo {
+            double weight;
+            std::vector<uint32_t> edges;
+        };
+
+        // Отображает файл только для чтения; бросает std::runtime_error,
+        // если файл не открывается или не является образом справочника
+        explicit Image(const std::filesystem::path& path);
+        Image(const Image&) = delete;
+        Image& operator=(const Image&) = delete;
+        ~Image();
+
+        std::optional<uint32_t> FindStop(std::string_view name) const;
+        std::optional<uint32_t> FindBus(std::string_view name) const;
+        std::string_view GetStopName(uint32_t stop) const;
+        std::string_view GetBusName(uint32_t bus) const;
+        Ids GetStopBuses(uint32_t stop) const;
+        std::optional<transport_db::BusInfo> GetBusInfo(std::string_view name) const;
+
+        int GetBusWaitTime() const;
+        double GetBusVelocity() const;
+        std::string_view GetMapRender() const;
+
+        const EdgeRecord& GetEdge(uint32_t edge) const;
+        std::optional<RouteInfo> BuildRoute(uint32_t from, uint32_t to) const;
+
+    private:
+        template <typename Record>
+        struct Section {
+            const Record* data = nullptr;
+            size_t size = 0;
+        };
+
+        template <typename Record>
+        Section<Record> GetSection(uint32_t id) const;
+        std::string_view GetString(uint32_t offset, uint32_t size) const;
+        template <typename Record>
+        std::optional<uint32_t> FindByName(const Section<uint32_t>& index, const Section<Record>& records, std::string_view name) const;
+
+        void LoadSections();
+        void Unmap();
+
+        void* mapping_ = nullptr;
+        // Без mmap (Windows) образ читается в память целиком
+        std::string buffer_;
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+
+        Section<char> strings_;
+        Section<StopRecord> stops_;
+        Section<uint32_t> stop_index_;
+        Section<uint32_t> stop_buses_;
+        Section<BusRecord> buses_;
+        Section<uint32_t> bus_index_;
+        Section<uint32_t> bus_stops_;
+        Section<DistanceRecord> distances_;
+        Section<RoutingSettingsRecord> routing_settings_;
+        Section<char> map_render_;
+        Section<EdgeRecord> edges_;
+        Section<RouteRecord> routes_;
+    };
+
+} // namespace catalogue_image
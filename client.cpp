@@ -0,0 +1,55 @@
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "query_protocol.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+using namespace std::literals;
+
+// Отправляет документ с stat_requests из stdin серверу transport_catalogue serve
+// и печатает ответ. Используется для локальной проверки сервера.
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: transport_catalogue_client <socket_path>\n"sv;
+        return 1;
+    }
+#ifndef _WIN32
+    const std::string_view socket_path(argv[1]);
+    sockaddr_un address{};
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path is too long\n"sv;
+        return 1;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        std::cerr << "connect: "sv << std::strerror(errno) << '\n';
+        return 1;
+    }
+
+    const std::string request(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>{});
+    std::string answer;
+    if (!query_protocol::WriteFrame(fd, request) || !query_protocol::ReadFrame(fd, answer)) {
+        std::cerr << "Connection closed by server\n"sv;
+        close(fd);
+        return 1;
+    }
+    close(fd);
+    std::cout << answer;
+    return 0;
+#else
+    std::cerr << "Unix sockets are not supported on this platform\n"sv;
+    return 1;
+#endif
+}
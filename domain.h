@@ -5,6 +5,7 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <utility>
 #include "geo.h"
 
 namespace domain {
@@ -18,12 +19,14 @@ namespace domain {
         explicit Stop(size_t id, geo::Coordinates coordinates, std::string name) 
             : edge_id(id)
             , coords(coordinates)
-            , name(name) {
+            , name(std::move(name)) {
         }
     };
 
     struct Bus
     {
+        // Порядковый номер автобуса в справочнике
+        size_t id = 0;
         std::string bus_number;
         std::vector<Stop*> stops = {};
         bool is_roundtrip = false;
@@ -1,238 +1,15 @@
 #include "json.h"
 
-#include <iterator>
+#include <cctype>
+#include <cstdio>
+#include <sstream>
+#include <string_view>
 
 namespace json {
 
     namespace {
         using namespace std::literals;
 
-        Node LoadNode(std::istream& input);
-        Node LoadString(std::istream& input);
-
-        std::string LoadLiteral(std::istream& input) {
-            std::string s;
-            while (std::isalpha(input.peek())) {
-                s.push_back(static_cast<char>(input.get()));
-            }
-            return s;
-        }
-
-        Node LoadArray(std::istream& input) {
-            std::vector<Node> result;
-
-            for (char c; input >> c && c != ']';) {
-                if (c != ',') {
-                    input.putback(c);
-                }
-                result.push_back(LoadNode(input));
-            }
-            if (!input) {
-                throw ParsingError("Array parsing error"s);
-            }
-            return Node(std::move(result));
-        }
-
-        Node LoadDict(std::istream& input) {
-            Dict dict;
-
-            for (char c; input >> c && c != '}';) {
-                if (c == '"') {
-                    std::string key = LoadString(input).AsString();
-                    if (input >> c && c == ':') {
-                        if (dict.find(key) != dict.end()) {
-                            throw ParsingError("Duplicate key '"s + key + "' have been found");
-                        }
-                        dict.emplace(std::move(key), LoadNode(input));
-                    }
-                    else {
-                        throw ParsingError(": is expected but '"s + c + "' has been found"s);
-                    }
-                }
-                else if (c != ',') {
-                    throw ParsingError(R"(',' is expected but ')"s + c + "' has been found"s);
-                }
-            }
-            if (!input) {
-                throw ParsingError("Dictionary parsing error"s);
-            }
-            return Node(std::move(dict));
-        }
-
-        Node LoadString(std::istream& input) {
-            auto it = std::istreambuf_iterator<char>(input);
-            auto end = std::istreambuf_iterator<char>();
-            std::string s;
-            while (true) {
-                if (it == end) {
-                    throw ParsingError("String parsing error");
-                }
-                const char ch = *it;
-                if (ch == '"') {
-                    ++it;
-                    break;
-                }
-                else if (ch == '\\') {
-                    ++it;
-                    if (it == end) {
-                        throw ParsingError("String parsing error");
-                    }
-                    const char escaped_char = *(it);
-                    switch (escaped_char) {
-                    case 'n':
-                        s.push_back('\n');
-                        break;
-                    case 't':
-                        s.push_back('\t');
-                        break;
-                    case 'r':
-                        s.push_back('\r');
-                        break;
-                    case '"':
-                        s.push_back('"');
-                        break;
-                    case '\\':
-                        s.push_back('\\');
-                        break;
-                    default:
-                        throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
-                    }
-                }
-                else if (ch == '\n' || ch == '\r') {
-                    throw ParsingError("Unexpected end of line"s);
-                }
-                else {
-                    s.push_back(ch);
-                }
-                ++it;
-            }
-
-            return Node(std::move(s));
-        }
-
-        Node LoadBool(std::istream& input) {
-            const auto s = LoadLiteral(input);
-            if (s == "true"sv) {
-                return Node{ true };
-            }
-            else if (s == "false"sv) {
-                return Node{ false };
-            }
-            else {
-                throw ParsingError("Failed to parse '"s + s + "' as bool"s);
-            }
-        }
-
-        Node LoadNull(std::istream& input) {
-            if (auto literal = LoadLiteral(input); literal == "null"sv) {
-                return Node{ nullptr };
-            }
-            else {
-                throw ParsingError("Failed to parse '"s + literal + "' as null"s);
-            }
-        }
-
-        Node LoadNumber(std::istream& input) {
-            std::string parsed_num;
-
-            // Считывает в parsed_num очередной символ из input
-            auto read_char = [&parsed_num, &input] {
-                parsed_num += static_cast<char>(input.get());
-                if (!input) {
-                    throw ParsingError("Failed to read number from stream"s);
-                }
-            };
-
-            // Считывает одну или более цифр в parsed_num из input
-            auto read_digits = [&input, read_char] {
-                if (!std::isdigit(input.peek())) {
-                    throw ParsingError("A digit is expected"s);
-                }
-                while (std::isdigit(input.peek())) {
-                    read_char();
-                }
-            };
-
-            if (input.peek() == '-') {
-                read_char();
-            }
-            // Парсим целую часть числа
-            if (input.peek() == '0') {
-                read_char();
-                // После 0 в JSON не могут идти другие цифры
-            }
-            else {
-                read_digits();
-            }
-
-            bool is_int = true;
-            // Парсим дробную часть числа
-            if (input.peek() == '.') {
-                read_char();
-                read_digits();
-                is_int = false;
-            }
-
-            // Парсим экспоненциальную часть числа
-            if (int ch = input.peek(); ch == 'e' || ch == 'E') {
-                read_char();
-                if (ch = input.peek(); ch == '+' || ch == '-') {
-                    read_char();
-                }
-                read_digits();
-                is_int = false;
-            }
-
-            try {
-                if (is_int) {
-                    // Сначала пробуем преобразовать строку в int
-                    try {
-                        return std::stoi(parsed_num);
-                    }
-                    catch (...) {
-                        // В случае неудачи, например, при переполнении
-                        // код ниже попробует преобразовать строку в double
-                    }
-                }
-                return std::stod(parsed_num);
-            }
-            catch (...) {
-                throw ParsingError("Failed to convert "s + parsed_num + " to number"s);
-            }
-        }
-
-        Node LoadNode(std::istream& input) {
-            char c;
-            if (!(input >> c)) {
-                throw ParsingError("Unexpected EOF"s);
-            }
-            switch (c) {
-            case '[':
-                return LoadArray(input);
-            case '{':
-                return LoadDict(input);
-            case '"':
-                return LoadString(input);
-            case 't':
-                // Атрибут [[fallthrough]] (провалиться) ничего не делает, и является
-                // подсказкой компилятору и человеку, что здесь программист явно задумывал
-                // разрешить переход к инструкции следующей ветки case, а не случайно забыл
-                // написать break, return или throw.
-                // В данном случае, встретив t или f, переходим к попытке парсинга
-                // литералов true либо false
-                [[fallthrough]];
-            case 'f':
-                input.putback(c);
-                return LoadBool(input);
-            case 'n':
-                input.putback(c);
-                return LoadNull(input);
-            default:
-                input.putback(c);
-                return LoadNumber(input);
-            }
-        }
-
         struct PrintContext {
             std::ostream& out;
             int indent_step = 4;
@@ -352,14 +129,462 @@ namespace json {
                 node.GetValue());
         }
 
+        // Печатает узел без отступов и переводов строк. Вывод накапливается
+        // во внутреннем буфере и сбрасывается в поток крупными блоками.
+        class CompactPrinter {
+        public:
+            explicit CompactPrinter(std::ostream& out)
+                : out_(out) {
+                buffer_.reserve(BUFFER_SIZE);
+            }
+
+            CompactPrinter(const CompactPrinter&) = delete;
+            CompactPrinter& operator=(const CompactPrinter&) = delete;
+
+            ~CompactPrinter() {
+                Flush();
+            }
+
+            void PrintNode(const Node& node) {
+                std::visit(
+                    [this](const auto& value) {
+                        Print(value);
+                    },
+                    node.GetValue());
+            }
+
+            void Flush() {
+                out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+                buffer_.clear();
+            }
+
+        private:
+            static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+            void Write(std::string_view text) {
+                buffer_.append(text);
+                if (buffer_.size() >= BUFFER_SIZE) {
+                    Flush();
+                }
+            }
+
+            void Print(std::nullptr_t) {
+                Write("null"sv);
+            }
+
+            void Print(bool value) {
+                Write(value ? "true"sv : "false"sv);
+            }
+
+            void Print(int value) {
+                char buf[16];
+                const int size = std::snprintf(buf, sizeof(buf), "%d", value);
+                Write({ buf, static_cast<size_t>(size) });
+            }
+
+            // Формат совпадает с выводом double через operator<< с точностью потока
+            void Print(double value) {
+                char buf[64];
+                const int size = std::snprintf(buf, sizeof(buf), "%.*g", static_cast<int>(out_.precision()), value);
+                Write({ buf, static_cast<size_t>(size) });
+            }
+
+            // Экранирование совпадает с PrintString, чтобы разбор обоих
+            // вариантов вывода давал одинаковый документ
+            void Print(const std::string& value) {
+                buffer_.push_back('"');
+                size_t plain_begin = 0;
+                for (size_t i = 0; i < value.size(); ++i) {
+                    std::string_view escaped;
+                    switch (value[i]) {
+                    case '\r':
+                        escaped = "\\r"sv;
+                        break;
+                    case '\n':
+                        escaped = "\\n "sv;
+                        break;
+                    case '"':
+                        escaped = "\\\""sv;
+                        break;
+                    case '\\':
+                        escaped = "\\\\"sv;
+                        break;
+                    default:
+                        continue;
+                    }
+                    buffer_.append(value, plain_begin, i - plain_begin);
+                    buffer_.append(escaped);
+                    plain_begin = i + 1;
+                }
+                buffer_.append(value, plain_begin, std::string::npos);
+                Write("\""sv);
+            }
+
+            void Print(const Array& nodes) {
+                buffer_.push_back('[');
+                bool first = true;
+                for (const Node& node : nodes) {
+                    if (!first) {
+                        buffer_.push_back(',');
+                    }
+                    first = false;
+                    PrintNode(node);
+                }
+                Write("]"sv);
+            }
+
+            void Print(const Dict& nodes) {
+                buffer_.push_back('{');
+                bool first = true;
+                for (const auto& [key, node] : nodes) {
+                    if (!first) {
+                        buffer_.push_back(',');
+                    }
+                    first = false;
+                    Print(key);
+                    buffer_.push_back(':');
+                    PrintNode(node);
+                }
+                Write("}"sv);
+            }
+
+            std::ostream& out_;
+            std::string buffer_;
+        };
+
     }  // namespace
 
-    Document Load(std::istream& input) {
-        return Document{ LoadNode(input) };
+    Reader::Reader(std::string_view text)
+        : text_(text) {
+    }
+
+    void Reader::SkipSpaces() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+            ++pos_;
+        }
+    }
+
+    char Reader::Peek() {
+        SkipSpaces();
+        if (pos_ == text_.size()) {
+            throw ParsingError("Unexpected EOF"s);
+        }
+        return text_[pos_];
+    }
+
+    bool Reader::AtEnd() {
+        SkipSpaces();
+        return pos_ == text_.size();
+    }
+
+    void Reader::Expect(char expected) {
+        if (const char c = Peek(); c != expected) {
+            throw ParsingError("'"s + expected + "' is expected but '"s + c + "' has been found"s);
+        }
+        ++pos_;
+    }
+
+    void Reader::BeginArray() {
+        Expect('[');
+    }
+
+    bool Reader::NextItem() {
+        char c = Peek();
+        if (c == ']') {
+            ++pos_;
+            return false;
+        }
+        if (c == ',') {
+            ++pos_;
+            c = Peek();
+        }
+        if (c == ']') {
+            throw ParsingError("Array parsing error"s);
+        }
+        return true;
+    }
+
+    void Reader::BeginDict() {
+        Expect('{');
+    }
+
+    std::optional<std::string_view> Reader::NextKey() {
+        char c = Peek();
+        if (c == '}') {
+            ++pos_;
+            return std::nullopt;
+        }
+        if (c == ',') {
+            ++pos_;
+        }
+        const std::string_view key = ReadString();
+        Expect(':');
+        return key;
+    }
+
+    std::string_view Reader::ReadString() {
+        Expect('"');
+        const size_t begin = pos_;
+        while (pos_ < text_.size() && text_[pos_] != '"' && text_[pos_] != '\\') {
+            if (text_[pos_] == '\n' || text_[pos_] == '\r') {
+                throw ParsingError("Unexpected end of line"s);
+            }
+            ++pos_;
+        }
+        if (pos_ == text_.size()) {
+            throw ParsingError("String parsing error"s);
+        }
+        if (text_[pos_] == '"') {
+            return text_.substr(begin, pos_++ - begin);
+        }
+
+        // Строка с экранированием раскодируется в собственное хранилище читателя
+        std::string& s = unescaped_.emplace_back(text_.substr(begin, pos_ - begin));
+        while (true) {
+            if (pos_ == text_.size()) {
+                throw ParsingError("String parsing error"s);
+            }
+            const char ch = text_[pos_++];
+            if (ch == '"') {
+                break;
+            }
+            else if (ch == '\\') {
+                if (pos_ == text_.size()) {
+                    throw ParsingError("String parsing error"s);
+                }
+                const char escaped_char = text_[pos_++];
+                switch (escaped_char) {
+                case 'n':
+                    s.push_back('\n');
+                    break;
+                case 't':
+                    s.push_back('\t');
+                    break;
+                case 'r':
+                    s.push_back('\r');
+                    break;
+                case '"':
+                    s.push_back('"');
+                    break;
+                case '\\':
+                    s.push_back('\\');
+                    break;
+                default:
+                    throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
+                }
+            }
+            else if (ch == '\n' || ch == '\r') {
+                throw ParsingError("Unexpected end of line"s);
+            }
+            else {
+                s.push_back(ch);
+            }
+        }
+        return s;
+    }
+
+    std::string_view Reader::ReadLiteral() {
+        SkipSpaces();
+        const size_t begin = pos_;
+        while (pos_ < text_.size() && std::isalpha(static_cast<unsigned char>(text_[pos_]))) {
+            ++pos_;
+        }
+        return text_.substr(begin, pos_ - begin);
+    }
+
+    bool Reader::ReadBool() {
+        const auto s = ReadLiteral();
+        if (s == "true"sv) {
+            return true;
+        }
+        else if (s == "false"sv) {
+            return false;
+        }
+        throw ParsingError("Failed to parse '"s + std::string(s) + "' as bool"s);
+    }
+
+    void Reader::ReadNull() {
+        if (const auto literal = ReadLiteral(); literal != "null"sv) {
+            throw ParsingError("Failed to parse '"s + std::string(literal) + "' as null"s);
+        }
+    }
+
+    Node Reader::ReadNumber() {
+        SkipSpaces();
+        const size_t begin = pos_;
+        auto peek_is = [this](char c) {
+            return pos_ < text_.size() && text_[pos_] == c;
+        };
+        auto read_digits = [this] {
+            if (pos_ == text_.size() || !std::isdigit(static_cast<unsigned char>(text_[pos_]))) {
+                throw ParsingError("A digit is expected"s);
+            }
+            while (pos_ < text_.size() && std::isdigit(static_cast<unsigned char>(text_[pos_]))) {
+                ++pos_;
+            }
+        };
+
+        if (peek_is('-')) {
+            ++pos_;
+        }
+        // После 0 в JSON не могут идти другие цифры
+        if (peek_is('0')) {
+            ++pos_;
+        }
+        else {
+            read_digits();
+        }
+
+        bool is_int = true;
+        if (peek_is('.')) {
+            ++pos_;
+            read_digits();
+            is_int = false;
+        }
+        if (peek_is('e') || peek_is('E')) {
+            ++pos_;
+            if (peek_is('+') || peek_is('-')) {
+                ++pos_;
+            }
+            read_digits();
+            is_int = false;
+        }
+
+        const std::string parsed_num(text_.substr(begin, pos_ - begin));
+        try {
+            if (is_int) {
+                try {
+                    return std::stoi(parsed_num);
+                }
+                catch (...) {
+                    // При переполнении int число читается как double
+                }
+            }
+            return std::stod(parsed_num);
+        }
+        catch (...) {
+            throw ParsingError("Failed to convert "s + parsed_num + " to number"s);
+        }
+    }
+
+    int Reader::ReadInt() {
+        return ReadNumber().AsInt();
+    }
+
+    double Reader::ReadDouble() {
+        return ReadNumber().AsDouble();
+    }
+
+    Node Reader::ReadScalar() {
+        switch (Peek()) {
+        case '"':
+            return std::string(ReadString());
+        case 't':
+            [[fallthrough]];
+        case 'f':
+            return ReadBool();
+        case 'n':
+            ReadNull();
+            return nullptr;
+        default:
+            return ReadNumber();
+        }
+    }
+
+    std::string_view Reader::SkipValue() {
+        const char first = Peek();
+        const size_t begin = pos_;
+        if (first == '"') {
+            ReadString();
+            return text_.substr(begin, pos_ - begin);
+        }
+        if (first != '[' && first != '{') {
+            ReadScalar();
+            return text_.substr(begin, pos_ - begin);
+        }
+        int depth = 0;
+        while (pos_ < text_.size()) {
+            const char c = text_[pos_++];
+            if (c == '"') {
+                while (pos_ < text_.size() && text_[pos_] != '"') {
+                    pos_ += text_[pos_] == '\\' ? 2 : 1;
+                }
+                ++pos_;
+            }
+            else if (c == '[' || c == '{') {
+                ++depth;
+            }
+            else if ((c == ']' || c == '}') && --depth == 0) {
+                return text_.substr(begin, pos_ - begin);
+            }
+        }
+        throw ParsingError("Unbalanced brackets"s);
+    }
+
+    std::vector<std::string_view> Reader::SplitArray() {
+        std::vector<std::string_view> items;
+        BeginArray();
+        while (NextItem()) {
+            items.push_back(SkipValue());
+        }
+        return items;
+    }
+
+    void Reader::Reset(std::string_view text) {
+        text_ = text;
+        pos_ = 0;
     }
 
     void Print(const Document& doc, std::ostream& output) {
         PrintNode(doc.GetRoot(), PrintContext{ output });
     }
 
+    void PrintCompact(const Document& doc, std::ostream& output) {
+        CompactPrinter printer(output);
+        printer.PrintNode(doc.GetRoot());
+    }
+
+    std::string PrintArrayItem(const Node& node, bool compact) {
+        std::ostringstream out;
+        if (compact) {
+            CompactPrinter printer(out);
+            printer.PrintNode(node);
+        }
+        else {
+            const PrintContext ctx{ out };
+            PrintNode(node, ctx.Indented());
+        }
+        return out.str();
+    }
+
+    void PrintPrintedArray(const std::vector<std::string>& items, std::ostream& output, bool compact) {
+        if (compact) {
+            output.put('[');
+            bool first = true;
+            for (const auto& item : items) {
+                if (!first) {
+                    output.put(',');
+                }
+                first = false;
+                output.write(item.data(), static_cast<std::streamsize>(item.size()));
+            }
+            output.put(']');
+            return;
+        }
+        const PrintContext ctx{ output };
+        const auto inner_ctx = ctx.Indented();
+        output << "[\n"sv;
+        bool first = true;
+        for (const auto& item : items) {
+            if (!first) {
+                output << ",\n"sv;
+            }
+            first = false;
+            inner_ctx.PrintIndent();
+            output.write(item.data(), static_cast<std::streamsize>(item.size()));
+        }
+        output.put('\n');
+        output.put(']');
+    }
+
 }  // namespace json
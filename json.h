@@ -1,17 +1,75 @@
 #pragma once
 
+#include <algorithm>
+#include <deque>
 #include <iostream>
-#include <map>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <variant>
 #include <vector>
 
 namespace json {
 
     class Node;
-    using Dict = std::map<std::string, Node>;
     using Array = std::vector<Node>;
 
+    // Словарь хранится как отсортированный по ключу непрерывный массив пар,
+    // поиск выполняется двоичным поиском. Порядок обхода совпадает с std::map.
+    class Dict {
+    public:
+        using value_type = std::pair<std::string, Node>;
+        using Storage = std::vector<value_type>;
+        using iterator = Storage::iterator;
+        using const_iterator = Storage::const_iterator;
+
+        Dict() = default;
+        // Повторяющийся ключ в списке - ошибка программы: std::logic_error
+        Dict(std::initializer_list<value_type> items);
+
+        // Принимает пары в произвольном порядке; сортирует их один раз.
+        // Из повторяющихся ключей, как при вставке в std::map, остаётся
+        // первый по порядку; тогда возвращается false.
+        bool Assign(Storage items);
+
+        const_iterator begin() const {
+            return items_.begin();
+        }
+        const_iterator end() const {
+            return items_.end();
+        }
+        size_t size() const {
+            return items_.size();
+        }
+        bool empty() const {
+            return items_.empty();
+        }
+        void reserve(size_t count) {
+            items_.reserve(count);
+        }
+
+        const_iterator find(std::string_view key) const;
+        size_t count(std::string_view key) const;
+        const Node& at(std::string_view key) const;
+        Node& operator[](std::string_view key);
+        std::pair<iterator, bool> insert(value_type item);
+        template <typename... Args>
+        std::pair<iterator, bool> emplace(std::string key, Args&&... args);
+
+        bool operator==(const Dict& rhs) const;
+        bool operator!=(const Dict& rhs) const {
+            return !(*this == rhs);
+        }
+
+    private:
+        iterator LowerBound(std::string_view key);
+        const_iterator LowerBound(std::string_view key) const;
+
+        Storage items_;
+    };
+
     class ParsingError : public std::runtime_error {
     public:
         using runtime_error::runtime_error;
@@ -75,6 +133,14 @@ namespace json {
 
             return std::get<Array>(*this);
         }
+        Array& AsArray() {
+            using namespace std::literals;
+            if (!IsArray()) {
+                throw std::logic_error("Not an array"s);
+            }
+
+            return std::get<Array>(*this);
+        }
 
         bool IsString() const {
             return std::holds_alternative<std::string>(*this);
@@ -99,6 +165,14 @@ namespace json {
 
             return std::get<Dict>(*this);
         }
+        Dict& AsDict() {
+            using namespace std::literals;
+            if (!IsDict()) {
+                throw std::logic_error("Not a dict"s);
+            }
+
+            return std::get<Dict>(*this);
+        }
 
         bool operator==(const Node& rhs) const {
             return GetValue() == rhs.GetValue();
@@ -107,12 +181,137 @@ namespace json {
         const Value& GetValue() const {
             return *this;
         }
+        Value& GetValue() {
+            return *this;
+        }
     };
 
     inline bool operator!=(const Node& lhs, const Node& rhs) {
         return !(lhs == rhs);
     }
 
+    inline Dict::Dict(std::initializer_list<value_type> items) {
+        using namespace std::literals;
+        if (!Assign(Storage(items))) {
+            throw std::logic_error("Duplicate key in Dict initializer list"s);
+        }
+    }
+
+    inline bool Dict::Assign(Storage items) {
+        std::stable_sort(items.begin(), items.end(), [](const value_type& lhs, const value_type& rhs) {
+            return lhs.first < rhs.first;
+        });
+        const auto unique_end = std::unique(items.begin(), items.end(), [](const value_type& lhs, const value_type& rhs) {
+            return lhs.first == rhs.first;
+        });
+        const bool unique = unique_end == items.end();
+        items.erase(unique_end, items.end());
+        items_ = std::move(items);
+        return unique;
+    }
+
+    inline Dict::iterator Dict::LowerBound(std::string_view key) {
+        return std::lower_bound(items_.begin(), items_.end(), key, [](const value_type& item, std::string_view k) {
+            return std::string_view(item.first) < k;
+        });
+    }
+
+    inline Dict::const_iterator Dict::LowerBound(std::string_view key) const {
+        return std::lower_bound(items_.begin(), items_.end(), key, [](const value_type& item, std::string_view k) {
+            return std::string_view(item.first) < k;
+        });
+    }
+
+    inline Dict::const_iterator Dict::find(std::string_view key) const {
+        const auto it = LowerBound(key);
+        return (it != items_.end() && it->first == key) ? it : items_.end();
+    }
+
+    inline size_t Dict::count(std::string_view key) const {
+        return find(key) == items_.end() ? 0 : 1;
+    }
+
+    inline const Node& Dict::at(std::string_view key) const {
+        using namespace std::literals;
+        const auto it = find(key);
+        if (it == items_.end()) {
+            throw std::out_of_range("Key '"s + std::string(key) + "' not found"s);
+        }
+        return it->second;
+    }
+
+    inline Node& Dict::operator[](std::string_view key) {
+        auto it = LowerBound(key);
+        if (it == items_.end() || it->first != key) {
+            it = items_.emplace(it, std::string(key), Node{});
+        }
+        return it->second;
+    }
+
+    inline std::pair<Dict::iterator, bool> Dict::insert(value_type item) {
+        auto it = LowerBound(item.first);
+        if (it != items_.end() && it->first == item.first) {
+            return { it, false };
+        }
+        return { items_.insert(it, std::move(item)), true };
+    }
+
+    template <typename... Args>
+    std::pair<Dict::iterator, bool> Dict::emplace(std::string key, Args&&... args) {
+        return insert(value_type(std::move(key), Node(std::forward<Args>(args)...)));
+    }
+
+    inline bool Dict::operator==(const Dict& rhs) const {
+        return std::equal(items_.begin(), items_.end(), rhs.items_.begin(), rhs.items_.end());
+    }
+
+    // Последовательное чтение JSON-текста из памяти без построения документа.
+    // Строки без экранирования возвращаются как string_view на исходный текст,
+    // экранированные раскодируются во внутреннее хранилище читателя;
+    // и то и другое должно жить, пока используются полученные строки.
+    class Reader {
+    public:
+        explicit Reader(std::string_view text);
+
+        // Следующий значимый символ без его извлечения
+        char Peek();
+        bool AtEnd();
+
+        void BeginArray();
+        // Переходит к следующему элементу массива; false, если массив закончился
+        bool NextItem();
+
+        void BeginDict();
+        // Читает очередной ключ словаря вместе с ':'; nullopt, если словарь закончился
+        std::optional<std::string_view> NextKey();
+
+        std::string_view ReadString();
+        Node ReadNumber();
+        int ReadInt();
+        double ReadDouble();
+        bool ReadBool();
+        void ReadNull();
+        Node ReadScalar();
+
+        // Пропускает значение любого типа и возвращает его текст
+        std::string_view SkipValue();
+        // Читает массив целиком и возвращает тексты его элементов, не разбирая их
+        std::vector<std::string_view> SplitArray();
+
+        // Переключает читателя на другой текст, сохраняя хранилище
+        // раскодированных строк, на которое могут ссылаться прочитанные значения
+        void Reset(std::string_view text);
+
+    private:
+        void SkipSpaces();
+        void Expect(char expected);
+        std::string_view ReadLiteral();
+
+        std::string_view text_;
+        size_t pos_ = 0;
+        std::deque<std::string> unescaped_;
+    };
+
     class Document {
     public:
         explicit Document(Node root)
@@ -135,8 +334,15 @@ namespace json {
         return !(lhs == rhs);
     }
 
-    Document Load(std::istream& input);
-
     void Print(const Document& doc, std::ostream& output);
 
+    // Печать без отступов и пробелов между элементами, через внутренний буфер
+    void PrintCompact(const Document& doc, std::ostream& output);
+
+    // Элементы массива верхнего уровня можно напечатать по отдельности
+    // (например, в разных потоках) и затем склеить; результат совпадает
+    // с Print или PrintCompact для массива из этих элементов
+    std::string PrintArrayItem(const Node& node, bool compact);
+    void PrintPrintedArray(const std::vector<std::string>& items, std::ostream& output, bool compact);
+
 }  // namespace json
@@ -12,7 +12,7 @@ KeyItemContext Builder::Key(std::string key) {
     if (!(!nodes_stack_.empty() && nodes_stack_.back()->IsDict())) {
         throw std::logic_error("Key outside the dictionary");
     }
-    nodes_stack_.emplace_back(&const_cast<Dict&>(nodes_stack_.back()->AsDict())[key]);
+    nodes_stack_.emplace_back(&nodes_stack_.back()->AsDict()[key]);
     return *this;
 }
 
@@ -21,10 +21,10 @@ Builder& Builder::Value(Node value) {
         throw std::logic_error("Value error");
     }
     if (nodes_stack_.back()->IsArray()) {
-        const_cast<Array&>(nodes_stack_.back()->AsArray()).emplace_back(value);
+        nodes_stack_.back()->AsArray().emplace_back(std::move(value));
     }
     else {
-        *nodes_stack_.back() = value;
+        *nodes_stack_.back() = std::move(value);
         nodes_stack_.pop_back();
     }
     return *this;
@@ -66,7 +66,7 @@ Node Builder::Build() {
     if (!nodes_stack_.empty()) {
         throw std::logic_error("Object haven't build");
     }
-    return root_;
+    return std::move(root_);
 }
 
 KeyItemContext ItemContext::Key(std::string key) {
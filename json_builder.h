@@ -1,5 +1,9 @@
+#pragma once
+
 #include "json.h"
 
+#include <utility>
+
 namespace json {
     class ItemContext;
     class KeyItemContext;
@@ -23,13 +27,13 @@ namespace json {
         std::vector<Node*> nodes_stack_;
 
         template <typename T>
-        void InputResult(T elem) {
+        void InputResult(T&& elem) {
             if (nodes_stack_.back()->IsArray()) {
-                const_cast<Array&>(nodes_stack_.back()->AsArray()).push_back(elem);
-                nodes_stack_.emplace_back(&const_cast<Array&>(nodes_stack_.back()->AsArray()).back());
+                Array& arr = nodes_stack_.back()->AsArray();
+                nodes_stack_.emplace_back(&arr.emplace_back(std::forward<T>(elem)));
             }
             else {
-                *nodes_stack_.back() = elem;
+                *nodes_stack_.back() = std::forward<T>(elem);
             }
         }
     };
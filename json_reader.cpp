@@ -5,11 +5,63 @@
 #include "serialization.h"
 
 #include <sstream>
+#include <stdexcept>
 #include <optional>
 #include <cstdint>
+#include <deque>
 #include <utility>
 #include <vector>
 #include <string>
+#include <iterator>
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+    using namespace std::literals;
+
+    // Позиция значения ключа key в напечатанном ответе. Кавычка внутри строкового
+    // значения всегда экранирована, поэтому найденный ключ - ключ ответа, а не часть названия
+    size_t FindValuePos(std::string_view text, std::string_view key, bool compact) {
+        const std::string pattern = "\""s.append(key).append(compact ? "\":"sv : "\": "sv);
+        return text.find(pattern) + pattern.size();
+    }
+
+    // Вырезает из ответа, напечатанного с request_id = 0, этот ноль
+    // и возвращает позицию, куда вставлять настоящий id
+    size_t CutRequestId(std::string& text, bool compact) {
+        const size_t id_pos = FindValuePos(text, "request_id"sv, compact);
+        text.erase(id_pos, 1);
+        return id_pos;
+    }
+
+    // Образ и плоская база - готовые к отображению таблицы: они не сжимаются,
+    // не дополняются дельтой и не хранят исходный порядок остановок, поэтому
+    // эти настройки вместе с ними - ошибка, а не молча пропущенный параметр
+    void CheckImageSettings(const request_schema::RequestBatch& batch) {
+        const auto reject = [](std::string_view setting) {
+            throw std::runtime_error(std::string(setting) + " can not be combined with image or flat format"s);
+        };
+        if (batch.delta_file) {
+            reject("delta"sv);
+        }
+        if (batch.compress_base) {
+            reject("compression"sv);
+        }
+        if (batch.stop_order != stop_order::StopOrder::INPUT) {
+            reject("stop_order"sv);
+        }
+    }
+
+    std::string SpliceRequestId(serialize::AnswerFragment fragment, int id) {
+        const std::string id_text = std::to_string(id);
+        std::string answer;
+        answer.reserve(fragment.text.size() + id_text.size());
+        answer.append(fragment.text.substr(0, fragment.id_pos));
+        answer.append(id_text);
+        answer.append(fragment.text.substr(fragment.id_pos));
+        return answer;
+    }
+}
 
 namespace json_pro
 {
@@ -22,296 +74,804 @@ namespace json_pro
         , result_map_render_(result_map_render)
         , transport_router_(transport_router) {}
 
-    void JSONreader::LoadJSON( std::istream& input) {
-        json::Document doc = json::Load(input);
-        const auto load = doc.GetRoot().AsDict(); 
-        base_requests_ = load.at("base_requests").AsArray();
-        if (load.find("routing_settings") != load.end()) {
-            route_requests_ = load.at("routing_settings").AsDict();
-        }
-                
-        FillCatalogueStop( doc);
-        FillCatalogueBus( doc);
-                serializator_.SetSetting(DoSerialization(load.at("serialization_settings").AsDict()));
-        if (load.find("render_settings") != load.end()) {
-            render_requests_ = load.at("render_settings").AsDict();
-            renderer::RenderSettings renset(render_requests_);
-            renderer::MapRenderer ren(renset, t_c_);
+    void JSONreader::FillFromBaseRequests(const request_schema::RequestBatch& batch) {
+        FillCatalogueStop(batch.stops);
+        FillCatalogueBus(batch.buses);
+        serializator_.SetSetting(DoSerialization(batch.serialization_file.value()));
+        serializator_.SetCompression(batch.compress_base);
+    }
+
+    void JSONreader::ReorderStops(request_schema::RequestBatch& batch) {
+        using stop_order::StopOrder;
+        if (batch.stop_order == StopOrder::INPUT) {
+            return;
+        }
+        stop_order::Permutation order;
+        if (batch.stop_order == StopOrder::HILBERT) {
+            std::vector<geo::Coordinates> coordinates;
+            coordinates.reserve(batch.stops.size());
+            for (const auto& stop : batch.stops) {
+                coordinates.push_back(stop.coordinates);
+            }
+            order = stop_order::HilbertOrder(coordinates);
+        }
+        else {
+            std::unordered_map<std::string_view, uint32_t> positions;
+            positions.reserve(batch.stops.size());
+            for (const auto& stop : batch.stops) {
+                positions.emplace(stop.name, static_cast<uint32_t>(positions.size()));
+            }
+            std::vector<std::vector<uint32_t>> routes;
+            routes.reserve(batch.buses.size());
+            for (const auto& bus : batch.buses) {
+                auto& route = routes.emplace_back();
+                route.reserve(bus.stops.size());
+                for (const std::string_view name : bus.stops) {
+                    if (const auto it = positions.find(name); it != positions.end()) {
+                        route.push_back(it->second);
+                    }
+                }
+            }
+            order = stop_order::ReverseCuthillMcKeeOrder(batch.stops.size(), routes);
+        }
+        std::vector<request_schema::StopRequest> stops;
+        stops.reserve(batch.stops.size());
+        for (const uint32_t position : order) {
+            stops.push_back(std::move(batch.stops[position]));
+        }
+        batch.stops = std::move(stops);
+        serializator_.SetStopOrder(batch.stop_order, std::move(order));
+    }
+
+    void JSONreader::RenderMap(const request_schema::RequestBatch& batch) {
+        if (batch.render_settings) {
+            renderer::MapRenderer ren(*batch.render_settings, t_c_);
             result_map_render_ = ren.DocumentMapToPrint();
         }
-        serializator_.SerializeMapRender(result_map_render_);
+    }
+
+    void JSONreader::SerializeRoutingSettings(const request_schema::RequestBatch& batch) {
+        if (batch.routing_settings) {
+            std::map<std::string, double> map_velosity{ {"bus_velocity", batch.routing_settings->bus_velocity} };
+            serializator_.SerializeRouterSetVelosity(map_velosity);
+            std::map<std::string, int> map_time{ {"bus_wait_time", batch.routing_settings->bus_wait_time} };
+            serializator_.SerializeRouterSetTime(map_time);
+        }
+    }
+
+    void JSONreader::LoadJSON( std::istream& input) {
+        using request_schema::RequestType;
+        request_schema::RequestBatch batch = request_schema::DecodeRequests(input);
+        if (batch.image_file || batch.flat_format) {
+            CheckImageSettings(batch);
+        }
+
+        ReorderStops(batch);
+        FillFromBaseRequests(batch);
+        routing_settings_ = batch.routing_settings.value_or(request_schema::RoutingSettings{});
+
+        // Справочник заполнен, дальше этапы только читают его. Они выполняются
+        // графом задач: каждый начинается, как только готово то, от чего он зависит,
+        // и запись остановок, расстояний и автобусов идёт одновременно
+        // с печатью карты и готовых ответов
+        thread_pool::TaskGraph graph;
+        const auto render = graph.Add([&] {
+            RenderMap(batch);
+        });
+
+        std::vector<std::string> image_files;
+        if (batch.image_file) {
+            image_files.push_back(*batch.image_file);
+        }
+        if (batch.flat_format) {
+            image_files.push_back(*batch.serialization_file);
+        }
+        if (!image_files.empty()) {
+            const auto router = graph.Add([this] {
+                GetRouter();
+            });
+            for (const auto& file : image_files) {
+                graph.Add([this, file] {
+                    catalogue_image::WriteImage(file, t_c_, transport_router_, GetRouter(), result_map_render_);
+                }, { render, router });
+            }
+        }
 
-        for (const auto& [key, value] : route_requests_) {
-            if (key == "bus_velocity") {
-                std::map<std::string, double> map_velosity{ {"bus_velocity", value.AsDouble()} };
-                serializator_.SerializeRouterSetVelosity(map_velosity);
+        // Готовые ответы печатаются кусками параллельно и дописываются в базу
+        // по порядку, каждый кусок - после предыдущего. Кусок начинает печататься,
+        // когда записан кусок, стоящий на in_flight раньше, поэтому в памяти
+        // одновременно не больше in_flight кусков, а не все ответы базы
+        struct AnswerChunk {
+            RequestType type;
+            std::vector<std::string_view> names;
+            StoredAnswers answers;
+        };
+        std::deque<AnswerChunk> chunks;
+        thread_pool::ThreadPool pool;
+        if (!batch.flat_format) {
+            const auto catalogue = graph.Add([this] {
+                serializator_.BeginSerialize();
+                serializator_.SerializeCatalogue();
+            });
+            for (auto [type, names] : { std::pair{ RequestType::STOP, GetStopNames() }, std::pair{ RequestType::BUS, GetBusNames() } }) {
+                for (size_t begin = 0; begin < names.size(); begin += ANSWER_CHUNK_SIZE) {
+                    const size_t end = std::min(names.size(), begin + ANSWER_CHUNK_SIZE);
+                    chunks.push_back({ type, std::vector<std::string_view>(names.begin() + begin, names.begin() + end), {} });
+                }
             }
-            else if (key == "bus_wait_time") {
-                std::map<std::string, int> map_time{ {"bus_wait_time", value.AsInt()} };
-                serializator_.SerializeRouterSetTime(map_time);
+            const size_t in_flight = ANSWER_CHUNKS_PER_THREAD * pool.GetThreadCount();
+            auto last_write = catalogue;
+            std::vector<thread_pool::TaskGraph::TaskId> writes;
+            writes.reserve(chunks.size());
+            for (AnswerChunk& chunk : chunks) {
+                std::vector<thread_pool::TaskGraph::TaskId> print_after;
+                if (writes.size() >= in_flight) {
+                    print_after.push_back(writes[writes.size() - in_flight]);
+                }
+                const auto print = graph.Add([this, &chunk] {
+                    chunk.answers = PrintStoredAnswers(chunk.type, chunk.names);
+                }, print_after);
+                last_write = graph.Add([this, &chunk] {
+                    if (chunk.type == RequestType::STOP) {
+                        SaveStoredAnswers(chunk.answers, {}, false);
+                    }
+                    else {
+                        SaveStoredAnswers({}, chunk.answers, false);
+                    }
+                    StoredAnswers{}.swap(chunk.answers);
+                }, { print, last_write });
+                writes.push_back(last_write);
             }
+            graph.Add([&] {
+                SaveStoredAnswers({}, {}, true);
+                serializator_.SerializeMapRender(result_map_render_);
+                SerializeRoutingSettings(batch);
+                serializator_.FinishSerialize();
+            }, { render, last_write });
         }
 
-        serializator_.Serialize(t_c_);
+        graph.Run(pool);
+    }
+
+    void JSONreader::MakeDelta(std::istream& input) {
+        request_schema::RequestBatch batch = request_schema::DecodeRequests(input);
+
+        FillFromBaseRequests(batch);
+        RenderMap(batch);
+        serializator_.SerializeMapRender(result_map_render_);
+        SerializeRoutingSettings(batch);
+
+        // Ответы печатаются только для затронутых изменениями остановок и автобусов
+        serializator_.SerializeDelta(DoSerialization(batch.delta_file.value()),
+            [this](const std::vector<std::string_view>& stops, const std::vector<std::string_view>& buses) {
+                SerializeAnswerFragments(stops, buses, false);
+            });
     }
 
     void JSONreader::ReadRequests(std::istream& input) {
-        const auto load = json::Load(input).GetRoot().AsDict();
-        stat_requests_ = load.at("stat_requests").AsArray();
-        serializator_.SetSetting(DoSerialization(load.at("serialization_settings").AsDict()));
-        serializator_.DeserializeCatalogue(t_c_);
-        result_map_render_ = serializator_.DeserializeMapRenderer();
-        int bus_wait_time = serializator_.DeserializeRouterSetTime();
-        double velocity = serializator_.DeserializeRouterSetVelosity();
-        route_requests_.insert({ "bus_wait_time" , bus_wait_time });
-        route_requests_.insert({ "bus_velocity" , velocity });
-        
+        batch_ = request_schema::DecodeRequests(input, false);
+        compact_output_ = compact_output_ || batch_.compact_output;
+        std::optional<std::string> image_file = batch_.image_file;
+        if (!image_file && batch_.serialization_file) {
+            serializator_.SetSetting(DoSerialization(*batch_.serialization_file));
+            if (serializator_.DetectFormat() == serialize::BaseFormat::FLAT) {
+                image_file = batch_.serialization_file;
+            }
+        }
+        if (image_file) {
+            CheckImageSettings(batch_);
+            // Справочник и таблицы маршрутизатора уже лежат в образе
+            image_ = std::make_unique<catalogue_image::Image>(*image_file);
+            routing_settings_.bus_wait_time = image_->GetBusWaitTime();
+            routing_settings_.bus_velocity = image_->GetBusVelocity();
+            return;
+        }
+        serializator_.SetSetting(DoSerialization(batch_.serialization_file.value()));
+        serializator_.SetDelta(batch_.delta_file ? DoSerialization(*batch_.delta_file) : std::filesystem::path{});
+        if (load_whole_base_) {
+            serializator_.DeserializeCatalogue();
+        }
+        else {
+            serializator_.DeserializeCatalogue([this](uint32_t available) {
+                return ChooseBaseSections(available);
+            });
+        }
+        stored_answers_ = serializator_.HasAnswerFragments();
+        routing_settings_.bus_wait_time = serializator_.DeserializeRouterSetTime();
+        routing_settings_.bus_velocity = serializator_.DeserializeRouterSetVelosity();
+        const bool has_route_requests = std::any_of(batch_.stat_requests.begin(), batch_.stat_requests.end(),
+            [](const request_schema::StatRequest& request) {
+                return request.type == request_schema::RequestType::ROUTE;
+            });
+        if (has_route_requests) {
+            StartRouterWarmUp();
+        }
     }
 
-    std::filesystem::path JSONreader::DoSerialization(const json::Dict& queryset)
-    {
-        return std::filesystem::path(queryset.at("file").AsString());
+    void JSONreader::StartRouterWarmUp() {
+        if (!image_ && !router_warm_up_.valid()) {
+            router_warm_up_ = std::async(std::launch::async, [this] {
+                GetRouter();
+            });
+        }
+    }
+
+    // Порядок совпадает с порядком остановок и автобусов в базе
+    std::vector<std::string_view> JSONreader::GetStopNames() const {
+        std::vector<std::string_view> names;
+        names.reserve(t_c_.GetAllStops().size());
+        for (const auto& stop : t_c_.GetAllStops()) {
+            names.push_back(stop.name);
+        }
+        return names;
+    }
+
+    std::vector<std::string_view> JSONreader::GetBusNames() const {
+        std::vector<std::string_view> names;
+        names.reserve(t_c_.GetAllBuses().size());
+        for (const auto& bus : t_c_.GetAllBuses()) {
+            names.push_back(bus.bus_number);
+        }
+        return names;
+    }
+
+    JSONreader::StoredAnswers JSONreader::PrintStoredAnswers(request_schema::RequestType type, const std::vector<std::string_view>& names) {
+        auto print = [this](const request_schema::StatRequest& request, bool compact) {
+            PrintedAnswer printed{ json::PrintArrayItem(Answer(request), compact), 0 };
+            printed.id_pos = CutRequestId(printed.text, compact);
+            return printed;
+        };
+        StoredAnswers answers;
+        answers.reserve(names.size());
+        for (const std::string_view name : names) {
+            request_schema::StatRequest request;
+            request.type = type;
+            request.name = name;
+            answers.emplace_back(print(request, false), print(request, true));
+        }
+        return answers;
+    }
+
+    void JSONreader::SaveStoredAnswers(const StoredAnswers& stop_answers, const StoredAnswers& bus_answers, bool with_map) {
+        for (const auto& [pretty, compact] : stop_answers) {
+            serializator_.AddStopAnswer({ pretty.text, pretty.id_pos }, { compact.text, compact.id_pos });
+        }
+        for (const auto& [pretty, compact] : bus_answers) {
+            serializator_.AddBusAnswer({ pretty.text, pretty.id_pos }, { compact.text, compact.id_pos });
+        }
+        if (with_map) {
+            serializator_.SerializeMapAnswer(json::PrintArrayItem(json::Node(result_map_render_), true));
+        }
+    }
+
+    void JSONreader::SerializeAnswerFragments(const std::vector<std::string_view>& stops, const std::vector<std::string_view>& buses, bool with_map) {
+        SaveStoredAnswers(PrintStoredAnswers(request_schema::RequestType::STOP, stops),
+            PrintStoredAnswers(request_schema::RequestType::BUS, buses), with_map);
+    }
+
+    void JSONreader::SetCompactOutput(bool compact) {
+        compact_output_ = compact;
+    }
+
+    void JSONreader::SetLoadWholeBase(bool whole) {
+        load_whole_base_ = whole;
     }
 
-    void JSONreader::FillCatalogueStop( json::Document& doc) {
-        for (const auto& node_map : base_requests_) {
-            if (node_map.AsDict().at("type").AsString() == "Stop") {
-                t_c_.AddStop(geo::Coordinates{ node_map.AsDict().at("latitude").AsDouble(),  node_map.AsDict().at("longitude").AsDouble() }, node_map.AsDict().at("name").AsString());;
+    uint32_t JSONreader::ChooseBaseSections(uint32_t available) const {
+        using namespace serialize;
+        auto stored_or = [available](uint32_t answers, uint32_t data) {
+            return (available & answers) != 0 ? answers : data;
+        };
+        uint32_t sections = 0;
+        for (const auto& request : batch_.stat_requests) {
+            switch (request.type) {
+            case request_schema::RequestType::STOP:
+                sections |= stored_or(SECTION_STOP_ANSWERS, SECTION_BUSES);
+                break;
+            case request_schema::RequestType::BUS:
+                // Автобус ищется по названию и для готового ответа
+                sections |= SECTION_BUSES | stored_or(SECTION_BUS_ANSWERS, SECTION_DISTANCES);
+                break;
+            case request_schema::RequestType::MAP:
+                sections |= stored_or(SECTION_MAP_ANSWER, SECTION_MAP);
+                break;
+            case request_schema::RequestType::ROUTE:
+                sections |= SECTION_BUSES | SECTION_DISTANCES;
+                break;
+            default:
+                break;
             }
         }
-        for (const auto& node_map : base_requests_) {
-            const auto& map = node_map.AsDict();
-            if (map.at("type").AsString() == "Stop") {
-                for (const auto& [key, val] : map.at("road_distances").AsDict()) {
-                    t_c_.SetDistance(t_c_.GetStopByName(map.at("name").AsString()), t_c_.GetStopByName(key), val.AsInt());
-                }
+        return sections;
+    }
+
+    std::filesystem::path JSONreader::DoSerialization(const std::string& file)
+    {
+        return std::filesystem::path(file);
+    }
+
+    void JSONreader::FillCatalogueStop(const std::vector<request_schema::StopRequest>& stops) {
+        size_t distance_count = 0;
+        for (const auto& stop : stops) {
+            distance_count += stop.road_distances.size();
+        }
+        t_c_.ReserveStops(stops.size());
+        t_c_.ReserveDistances(distance_count);
+        for (const auto& stop : stops) {
+            t_c_.AddStop(stop.coordinates, std::string(stop.name));
+        }
+        for (const auto& stop : stops) {
+            domain::Stop* from = t_c_.GetStopByName(stop.name);
+            for (const auto& [to, distance] : stop.road_distances) {
+                t_c_.SetDistance(from, t_c_.GetStopByName(to), distance);
             }
         }
     }
 
-    void JSONreader::FillCatalogueBus( json::Document& doc) {
-        for (const auto& node_map : base_requests_) {
-            const auto& map = node_map.AsDict();
-            if (map.at("type").AsString() == "Bus") {
-                domain::Bus bs;
-                bs.bus_number = map.at("name").AsString();
-                bs.is_roundtrip = map.at("is_roundtrip").AsBool();
-                int j = map.at("stops").AsArray().size();
-                for (size_t i = 0; i < j; ++i) {
-                    bs.stops.push_back(t_c_.GetStopByName(map.at("stops").AsArray()[i].AsString()));
-                }
-                if (map.at("is_roundtrip").AsBool() == false && j >= 2) {
-                    for (j = j - 2; j >= 0; ) {
-                        bs.stops.push_back(t_c_.GetStopByName(map.at("stops").AsArray()[j].AsString()));
-                        --j;
-                    }
+    void JSONreader::FillCatalogueBus(const std::vector<request_schema::BusRequest>& buses) {
+        t_c_.ReserveBuses(buses.size());
+        for (const auto& bus : buses) {
+            domain::Bus bs;
+            bs.bus_number = bus.name;
+            bs.is_roundtrip = bus.is_roundtrip;
+            bs.stops.reserve(bus.is_roundtrip ? bus.stops.size() : bus.stops.size() * 2);
+            for (const auto stop : bus.stops) {
+                bs.stops.push_back(t_c_.GetStopByName(stop));
+            }
+            if (!bus.is_roundtrip && bus.stops.size() >= 2) {
+                for (auto it = std::next(bus.stops.rbegin()); it != bus.stops.rend(); ++it) {
+                    bs.stops.push_back(t_c_.GetStopByName(*it));
                 }
-                t_c_.AddRoute(bs);
             }
+            t_c_.AddRoute(std::move(bs));
         }
     }
 
-    void JSONreader::SetGraphInfo(const json::Dict& route_set, transport_router::TransportRouter& router)
+    void JSONreader::SetGraphInfo(const request_schema::RoutingSettings& route_set, transport_router::TransportRouter& router)
     {
-        int bus_wait_time = 0;
-        double velocity = 0.0;
-        for (const auto& [key, value] : route_set) {
-            if (key == "bus_velocity") {
-                velocity = value.AsDouble();
-                router.SetVelocity(velocity);
+        router.SetVelocity(route_set.bus_velocity);
+        router.SetWaitTime(route_set.bus_wait_time);
+    }
+}
+
+void json_pro::JSONreader::BuildRouter()
+{
+    if (!image_) {
+        GetRouter();
+    }
+}
+
+const graph::Router<double>& json_pro::JSONreader::GetRouter()
+{
+    std::call_once(router_built_, [this] {
+        transport_graph_ = std::make_unique<graph::DirectedWeightedGraph<double>>(t_c_.GetAllStops().size());
+        SetGraphInfo(routing_settings_, transport_router_);
+        transport_router_.FillCatalogueGraph(t_c_, *transport_graph_);
+        router_ = std::make_unique<graph::Router<double>>(*transport_graph_);
+    });
+    return *router_;
+}
+
+std::string_view json_pro::JSONreader::GetMapRender()
+{
+    if (image_) {
+        return image_->GetMapRender();
+    }
+    std::call_once(map_loaded_, [this] {
+        result_map_render_ = serializator_.DeserializeMapRenderer();
+    });
+    return result_map_render_;
+}
+
+json::Node json_pro::JSONreader::Answer(const request_schema::StatRequest& request)
+{
+    using request_schema::RequestType;
+    switch (request.type) {
+    case RequestType::BUS:
+        return PrintBus(request.name, request.id);
+    case RequestType::STOP:
+        return PrintStop(request.name, request.id);
+    case RequestType::MAP:
+        return PrintVisual(GetMapRender(), request.id);
+    case RequestType::ROUTE:
+        if (image_) {
+            return PrintImageRoute(request.from, request.to, request.id);
+        }
+        return PrintGraph(request.from, request.to, request.id, GetRouter(), transport_router_);
+    default:
+        return nullptr;
+    }
+}
+
+std::optional<std::string> json_pro::JSONreader::FormatStoredAnswer(const request_schema::StatRequest& request, bool compact)
+{
+    using request_schema::RequestType;
+    switch (request.type) {
+    case RequestType::STOP:
+        if (const domain::Stop* stop = t_c_.GetStopByName(request.name)) {
+            if (const auto fragment = serializator_.GetStopAnswer(stop->edge_id, compact)) {
+                return SpliceRequestId(*fragment, request.id);
             }
-            else if (key == "bus_wait_time") {
-                bus_wait_time = value.AsInt();
-                router.SetWaitTime(bus_wait_time);
+        }
+        break;
+    case RequestType::BUS:
+        if (const domain::Bus* bus = t_c_.GetRouteByName(request.name)) {
+            if (const auto fragment = serializator_.GetBusAnswer(bus->id, compact)) {
+                return SpliceRequestId(*fragment, request.id);
             }
         }
+        break;
+    case RequestType::MAP:
+        if (const auto map = serializator_.GetMapAnswer()) {
+            // Вокруг карты печатается ответ с пустой строкой, и она заменяется
+            // уже экранированной картой из базы
+            std::string answer = json::PrintArrayItem(PrintVisual({}, request.id), compact);
+            answer.replace(FindValuePos(answer, "map"sv, compact), 2, *map);
+            return answer;
+        }
+        break;
+    default:
+        break;
     }
+    return std::nullopt;
 }
 
-void json_pro::JSONreader::PrintAnswer()    
+std::string json_pro::JSONreader::FormatAnswer(const request_schema::StatRequest& request, bool compact)
 {
-    using namespace std::literals;
-    graph::DirectedWeightedGraph<double> transport_graph(t_c_.GetAllStops().size());
-    SetGraphInfo(route_requests_, transport_router_);
-    transport_router_.FillCatalogueGraph(t_c_, transport_graph);
-    graph::Router transport_router(transport_graph);
-    json::Array arr{};
-    
-        for (const auto& node_map : stat_requests_) {
-            int id_q = node_map.AsDict().at("id").AsInt();
-            if (node_map.AsDict().at("type").AsString()[0] == 'B') {
-                arr.emplace_back(json_pro::JSONreader::PrintBus( node_map, id_q));
+    if (stored_answers_) {
+        if (auto answer = FormatStoredAnswer(request, compact)) {
+            return std::move(*answer);
+        }
+    }
+
+    std::optional<RouteKey> key;
+    if (request.type == request_schema::RequestType::ROUTE) {
+        if (image_) {
+            const auto from = image_->FindStop(request.from);
+            const auto to = image_->FindStop(request.to);
+            if (from && to) {
+                key = RouteKey{ *from, *to, compact };
+            }
+        }
+        else {
+            const domain::Stop* from = t_c_.GetStopByName(request.from);
+            const domain::Stop* to = t_c_.GetStopByName(request.to);
+            if (from != nullptr && to != nullptr) {
+                key = RouteKey{ static_cast<uint32_t>(from->edge_id), static_cast<uint32_t>(to->edge_id), compact };
             }
-            if (node_map.AsDict().at("type").AsString()[0] == 'S') {
-                arr.emplace_back(json_pro::JSONreader::PrintStop( node_map, id_q));
+        }
+    }
+    if (!key) {
+        const json::Node answer = Answer(request);
+        return answer.IsNull() ? std::string{} : json::PrintArrayItem(answer, compact);
+    }
+
+    std::shared_ptr<const PrintedAnswer> route;
+    if (auto cached = route_cache_.Get(*key)) {
+        route = std::move(*cached);
+    }
+    else {
+        request_schema::StatRequest pattern = request;
+        pattern.id = 0;
+        PrintedAnswer printed{ json::PrintArrayItem(Answer(pattern), compact), 0 };
+        printed.id_pos = CutRequestId(printed.text, compact);
+        route = std::make_shared<const PrintedAnswer>(std::move(printed));
+        route_cache_.Put(*key, route);
+    }
+    return SpliceRequestId({ route->text, route->id_pos }, request.id);
+}
+
+lru_cache::CacheStats json_pro::JSONreader::GetRouteCacheStats() const
+{
+    return route_cache_.GetStats();
+}
+
+void json_pro::JSONreader::PrintAnswer()    
+{
+    PrintAnswers(batch_.stat_requests, std::cout, compact_output_, true);
+}
+
+std::string json_pro::JSONreader::AnswerBatch(const request_schema::RequestBatch& batch)
+{
+    std::ostringstream output;
+    PrintAnswers(batch.stat_requests, output, batch.compact_output, false);
+    return output.str();
+}
+
+namespace {
+    // Сначала обходит запросы, которым не нужен маршрутизатор, затем Route:
+    // пока маршрутизатор строится в фоне, остальные ответы уже готовятся
+    template <typename Callback>
+    void ForEachRouteLast(const std::vector<request_schema::StatRequest>& requests, size_t begin, size_t end, Callback callback) {
+        using request_schema::RequestType;
+        for (size_t i = begin; i < end; ++i) {
+            if (requests[i].type != RequestType::ROUTE) {
+                callback(i);
             }
-            if (node_map.AsDict().at("type").AsString()[0] == 'M') {
-                arr.emplace_back(json_pro::JSONreader::PrintVisual(result_map_render_, id_q));
+        }
+        for (size_t i = begin; i < end; ++i) {
+            if (requests[i].type == RequestType::ROUTE) {
+                callback(i);
             }
-            if (node_map.AsDict().at("type").AsString()[0] == 'R') {
-                arr.emplace_back(json_pro::JSONreader::PrintGraph( node_map, id_q, transport_router, transport_router_));
+        }
+    }
+}
+
+void json_pro::JSONreader::PrintAnswers(const std::vector<request_schema::StatRequest>& requests, std::ostream& output,
+    bool compact, bool parallel)
+{
+    std::vector<std::string> printed(requests.size());
+    auto format_range = [&](size_t begin, size_t end) {
+        ForEachRouteLast(requests, begin, end, [&](size_t i) {
+            printed[i] = FormatAnswer(requests[i], compact);
+        });
+    };
+
+    // Запросы независимы и только читают справочник и маршрутизатор, поэтому
+    // большие пакеты отвечаются в пуле потоков, каждый ответ - в свой буфер
+    if (parallel && requests.size() >= PARALLEL_STAT_REQUESTS_THRESHOLD && thread_pool::ThreadPool::DefaultThreadCount() > 1) {
+        thread_pool::ThreadPool pool;
+        const size_t chunk_size = (requests.size() + pool.GetThreadCount() - 1) / pool.GetThreadCount();
+        std::vector<std::future<void>> chunks;
+        for (size_t begin = 0; begin < requests.size(); begin += chunk_size) {
+            const size_t end = std::min(requests.size(), begin + chunk_size);
+            chunks.push_back(pool.Submit([&format_range, begin, end] {
+                format_range(begin, end);
+            }));
+        }
+        // Исключение из любого куска дойдёт до вызывающего
+        for (auto& chunk : chunks) {
+            chunk.get();
+        }
+    }
+    else {
+        format_range(0, requests.size());
+    }
+
+    printed.erase(std::remove_if(printed.begin(), printed.end(), [](const std::string& item) {
+        return item.empty();
+    }), printed.end());
+    json::PrintPrintedArray(printed, output, compact);
+}
+
+namespace {
+    // id запроса из строки, которую не удалось обработать, если его можно прочитать
+    std::optional<int> FindRequestId(std::string_view line) {
+        using namespace std::literals;
+        try {
+            json::Reader reader(line);
+            reader.BeginDict();
+            while (const auto key = reader.NextKey()) {
+                if (*key == "id"sv) {
+                    return reader.ReadInt();
+                }
+                reader.SkipValue();
             }
         }
-    
-    json::Print(
-        json::Document{
-        json::Builder{}
-        .Value(arr)
-        .Build()
-        },
-        std::cout
-    );
+        catch (const std::exception&) {
+        }
+        return std::nullopt;
+    }
+
+    // Ответ на строку потока, которую не удалось обработать: request_id,
+    // если он читается, иначе номер строки во входе
+    json::Node PrintStreamError(std::string_view line, size_t line_number, const std::string& message) {
+        using namespace std::literals;
+        json::Builder builder;
+        builder.StartDict();
+        if (const auto id = FindRequestId(line)) {
+            builder.Key("request_id"s).Value(*id);
+        }
+        else {
+            builder.Key("line"s).Value(static_cast<int>(line_number));
+        }
+        return builder
+            .Key("error_message"s).Value(message)
+            .EndDict()
+            .Build();
+    }
 }
 
-json::Dict json_pro::JSONreader::PrintGraph( const json::Node& node_map, int id,
-    graph::Router<double> transport_router, transport_router::TransportRouter router)
+void json_pro::JSONreader::ProcessRequestStream(std::istream& input, std::ostream& output)
 {
-    using namespace std::literals;
-    std::string tmp_from = node_map.AsDict().at("from").AsString();
-    std::string tmp_to = node_map.AsDict().at("to").AsString();
-    const domain::Stop* stop_from = t_c_.GetStopByName(tmp_from);
-    const domain::Stop* stop_to = t_c_.GetStopByName(tmp_to);
-    if (stop_from == stop_to) {
+    std::string line;
+    if (!std::getline(input, line)) {
+        return;
+    }
+    std::istringstream settings(line);
+    SetLoadWholeBase(true);
+    ReadRequests(settings);
+    StartRouterWarmUp();
+
+    size_t unflushed = 0;
+    auto write_answer = [&](const request_schema::StatRequest& request) {
+        const std::string answer = FormatAnswer(request, true);
+        if (answer.empty()) {
+            return;
+        }
+        output.write(answer.data(), static_cast<std::streamsize>(answer.size()));
+        output.put('\n');
+        // Сбрасываем вывод пачками, но не оставляем ответы в буфере,
+        // если следующий запрос ещё не пришёл
+        if (++unflushed >= STREAM_FLUSH_BATCH || input.rdbuf()->in_avail() <= 0) {
+            output.flush();
+            unflushed = 0;
+        }
+    };
+
+    for (const auto& request : batch_.stat_requests) {
+        write_answer(request);
+    }
+    // Ошибка в одной строке не прерывает поток: вместо ответа на неё
+    // выводится объект с error_message
+    size_t line_number = 1;
+    while (std::getline(input, line)) {
+        ++line_number;
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        try {
+            json::Reader reader(line);
+            write_answer(request_schema::DecodeStatRequest(reader));
+        }
+        catch (const std::exception& e) {
+            const std::string error = json::PrintArrayItem(PrintStreamError(line, line_number, e.what()), true);
+            output.write(error.data(), static_cast<std::streamsize>(error.size()));
+            output.put('\n');
+            output.flush();
+            unflushed = 0;
+        }
+    }
+    output.flush();
+}
+
+namespace {
+    json::Node PrintNotFound(int id) {
+        using namespace std::literals;
         return
             json::Builder{}
             .StartDict()
-            .Key("total_time"s).Value(0)
-            .Key("request_id"s).Value(id)
-            .Key("items"s)
-            .StartArray()
-            .EndArray()
+            .Key("request_id").Value(id)
+            .Key("error_message").Value("not found"s)
             .EndDict()
-            .Build()
-            .AsDict();
+            .Build();
     }
-    else
-    {
-        const auto route_info = transport_router.graph::Router<double>::BuildRoute(stop_from->edge_id, stop_to->edge_id);
-        if (route_info.has_value()) {
-            const auto& elem = route_info.value().edges;
-            json::Array rout_arr;
-            int wait_time = router.GetWaitTime();
-            for (const auto& el : elem) {
-                const auto& edge = transport_router.GetGraph().GetEdge(el);
-                std::string stop_name{ t_c_.GetAllStops()[edge.from].name };
-                json::Dict wait = json::Builder{}
-                    .StartDict()
-                    .Key("time"s).Value(wait_time)
-                    .Key("type"s).Value("Wait"s)
-                    .Key("stop_name"s).Value(stop_name)
-                    .EndDict()
-                    .Build()
-                    .AsDict();
-                rout_arr.push_back(wait);
-                int span = edge.span_count;
-                std::string bus_name{ edge.bus };
-                json::Dict ride = json::Builder{}
-                    .StartDict()
-                    .Key("time"s).Value(edge.weight - wait_time)
-                    .Key("span_count"s).Value(span)
-                    .Key("bus"s).Value(bus_name)
-                    .Key("type"s).Value("Bus"s)
-                    .EndDict()
-                    .Build()
-                    .AsDict();
-                rout_arr.push_back(ride);
-            }
-            return json::Builder{}
+
+    // Ответ на Route; for_each_edge перебирает рёбра маршрута и передаёт
+    // в обработчик название остановки посадки, автобус, число пролётов и вес ребра
+    template <typename ForEachEdge>
+    json::Node PrintRoute(int id, double total_time, int wait_time, ForEachEdge for_each_edge) {
+        using namespace std::literals;
+        json::Builder builder;
+        auto items = builder
+            .StartDict()
+            .Key("total_time"s).Value(total_time)
+            .Key("request_id"s).Value(id)
+            .Key("items"s).StartArray();
+        for_each_edge([&](std::string_view stop_name, std::string_view bus, size_t span_count, double weight) {
+            items
                 .StartDict()
-                .Key("total_time"s).Value(route_info.value().weight)
-                .Key("request_id"s).Value(id).Key("items"s).Value(rout_arr)
-                .EndDict()
-                .Build()
-                .AsDict();
-        }
-        else {
-            return
-                json::Builder{}
+                .Key("time"s).Value(wait_time)
+                .Key("type"s).Value("Wait"s)
+                .Key("stop_name"s).Value(std::string(stop_name))
+                .EndDict();
+            items
                 .StartDict()
-                .Key("request_id").Value(id)
-                .Key("error_message").Value("not found"s)
-                .EndDict()
-                .Build()
-                .AsDict();
+                .Key("time"s).Value(weight - wait_time)
+                .Key("span_count"s).Value(static_cast<int>(span_count))
+                .Key("bus"s).Value(std::string(bus))
+                .Key("type"s).Value("Bus"s)
+                .EndDict();
+        });
+        return items
+            .EndArray()
+            .EndDict()
+            .Build();
+    }
+}
+
+json::Node json_pro::JSONreader::PrintGraph(std::string_view from, std::string_view to, int id,
+    const graph::Router<double>& transport_router, const transport_router::TransportRouter& router)
+{
+    const domain::Stop* stop_from = t_c_.GetStopByName(from);
+    const domain::Stop* stop_to = t_c_.GetStopByName(to);
+    if (stop_from == nullptr || stop_to == nullptr) {
+        return PrintNotFound(id);
+    }
+    if (stop_from == stop_to) {
+        return PrintRoute(id, 0, router.GetWaitTime(), [](auto&&) {});
+    }
+    const auto route_info = transport_router.BuildRoute(stop_from->edge_id, stop_to->edge_id);
+    if (!route_info.has_value()) {
+        return PrintNotFound(id);
+    }
+    return PrintRoute(id, route_info->weight, router.GetWaitTime(), [&](auto&& print_edge) {
+        for (const auto& el : route_info->edges) {
+            const auto& edge = transport_router.GetGraph().GetEdge(el);
+            print_edge(t_c_.GetStopById(edge.from).name, edge.bus, edge.span_count, edge.weight);
         }
+    });
+}
+
+json::Node json_pro::JSONreader::PrintImageRoute(std::string_view from, std::string_view to, int id)
+{
+    const auto stop_from = image_->FindStop(from);
+    const auto stop_to = image_->FindStop(to);
+    if (!stop_from || !stop_to) {
+        return PrintNotFound(id);
+    }
+    if (stop_from == stop_to) {
+        return PrintRoute(id, 0, image_->GetBusWaitTime(), [](auto&&) {});
+    }
+    const auto route_info = image_->BuildRoute(*stop_from, *stop_to);
+    if (!route_info.has_value()) {
+        return PrintNotFound(id);
     }
+    return PrintRoute(id, route_info->weight, image_->GetBusWaitTime(), [&](auto&& print_edge) {
+        for (const uint32_t el : route_info->edges) {
+            const catalogue_image::EdgeRecord& edge = image_->GetEdge(el);
+            print_edge(image_->GetStopName(edge.from), image_->GetBusName(edge.bus), edge.span_count, edge.weight);
+        }
+    });
+}
+
+json::Node json_pro::JSONreader::PrintVisual(std::string_view result_map_render, int id) {
     return
         json::Builder{}
         .StartDict()
+        .Key("map").Value(std::string(result_map_render))
         .Key("request_id").Value(id)
-        .Key("error_message").Value("not found"s)
         .EndDict()
-        .Build()
-        .AsDict();
+        .Build();
 }
 
-json::Dict json_pro::JSONreader::PrintVisual(std::string result_map_render, int id) {
+json::Node json_pro::JSONreader::PrintBus(std::string_view tmp, int id) {
+    std::optional<transport_db::BusInfo> bus_info;
+    if (image_) {
+        bus_info = image_->GetBusInfo(tmp);
+    }
+    else if (t_c_.GetRouteByName(tmp) != nullptr) {
+        bus_info = t_c_.GetBusInfo(tmp);
+    }
+    if (!bus_info) {
+        return PrintNotFound(id);
+    }
     return
         json::Builder{}
         .StartDict()
-        .Key("map").Value(result_map_render)
+        .Key("curvature").Value(bus_info->curvature_)
         .Key("request_id").Value(id)
+        .Key("route_length").Value(bus_info->meters_route_length_)
+        .Key("stop_count").Value(bus_info->stops_count_)
+        .Key("unique_stop_count").Value(bus_info->unique_stops_)
         .EndDict()
-        .Build()
-        .AsDict();
-}
-
-json::Dict json_pro::JSONreader::PrintBus( const json::Node& node_map, int id) {
-    using namespace std::literals;
-    std::string tmp = node_map.AsDict().at("name").AsString();
-    if (t_c_.GetRouteByName(tmp) != nullptr) {
-        return
-            json::Builder{}
-            .StartDict()
-            .Key("curvature").Value(t_c_.GetBusInfo(tmp).curvature_)
-            .Key("request_id").Value(id)
-            .Key("route_length").Value(t_c_.GetBusInfo(tmp).meters_route_length_)
-            .Key("stop_count").Value(t_c_.GetBusInfo(tmp).stops_count_)
-            .Key("unique_stop_count").Value(t_c_.GetBusInfo(tmp).unique_stops_)
-            .EndDict()
-            .Build()
-            .AsDict();
-    }
-    else {
-        return
-            json::Builder{}
-            .StartDict()
-            .Key("request_id").Value(id)
-            .Key("error_message").Value("not found"s)
-            .EndDict()
-            .Build()
-            .AsDict();
-    }
+        .Build();
 }
 
-json::Dict json_pro::JSONreader::PrintStop( const json::Node& node_map, int id) {
-    using namespace std::literals;
-    std::string tmp = node_map.AsDict().at("name").AsString();
-    if (t_c_.GetStopByName(tmp) != nullptr) {
-        json::Array arr_bus{};
-        for (const auto& elem : t_c_.GetStopInfo(tmp).bus_number_) {
-            arr_bus.emplace_back(elem);
+json::Node json_pro::JSONreader::PrintStop(std::string_view tmp, int id) {
+    json::Array arr_bus{};
+    if (image_) {
+        const auto stop = image_->FindStop(tmp);
+        if (!stop) {
+            return PrintNotFound(id);
+        }
+        for (const uint32_t bus : image_->GetStopBuses(*stop)) {
+            arr_bus.emplace_back(std::string(image_->GetBusName(bus)));
         }
-        return
-            json::Builder{}
-            .StartDict()
-            .Key("buses").Value(arr_bus)
-            .Key("request_id").Value(id)
-            .EndDict()
-            .Build()
-            .AsDict();
     }
     else {
-        return
-            json::Builder{}
-            .StartDict()
-            .Key("request_id").Value(id)
-            .Key("error_message").Value("not found"s)
-            .EndDict()
-            .Build()
-            .AsDict();
+        if (t_c_.GetStopByName(tmp) == nullptr) {
+            return PrintNotFound(id);
+        }
+        for (auto& elem : t_c_.GetStopInfo(tmp).bus_number_) {
+            arr_bus.emplace_back(std::move(elem));
+        }
     }
+    return
+        json::Builder{}
+        .StartDict()
+        .Key("buses").Value(std::move(arr_bus))
+        .Key("request_id").Value(id)
+        .EndDict()
+        .Build();
 }
-
-
-
@@ -6,8 +6,20 @@
 #include "transport_router.h"
 #include "router.h"
 #include "serialization.h"
+#include "catalogue_image.h"
+#include "request_schema.h"
+#include "thread_pool.h"
+#include "lru_cache.h"
 
 #include <iostream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace json_pro {
 	class JSONreader {
@@ -16,10 +28,64 @@ namespace json_pro {
 		transport_db::TransportCatalogue& t_c_;
 		std::string result_map_render_{};
 		transport_router::TransportRouter& transport_router_;
-		json::Array base_requests_{};
-		json::Dict route_requests_{};
-		json::Array stat_requests_{};
-		json::Dict render_requests_{};
+		request_schema::RequestBatch batch_{};
+		request_schema::RoutingSettings routing_settings_{};
+		bool compact_output_ = false;
+		std::unique_ptr<graph::DirectedWeightedGraph<double>> transport_graph_;
+		std::unique_ptr<graph::Router<double>> router_;
+		std::once_flag router_built_;
+		std::once_flag map_loaded_;
+		// Образ справочника из serialization_settings.image: если он задан,
+		// ответы читаются прямо из отображённого файла
+		std::unique_ptr<catalogue_image::Image> image_;
+		std::future<void> router_warm_up_;
+
+		// Ключ кэша ответов Route: пара остановок и вид вывода
+		struct RouteKey {
+			uint32_t from;
+			uint32_t to;
+			bool compact;
+
+			bool operator==(const RouteKey& other) const {
+				return from == other.from && to == other.to && compact == other.compact;
+			}
+		};
+
+		// std::hash для целых - тождественная функция, а шард кэша выбирается
+		// по остатку от деления хеша; финализатор splitmix64 перемешивает биты
+		// from и to, чтобы шард не зависел от одних младших битов to
+		struct RouteKeyHasher {
+			size_t operator()(const RouteKey& key) const noexcept {
+				uint64_t hash = (uint64_t{ key.from } << 32 | key.to) * 2 + key.compact;
+				hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+				hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+				return static_cast<size_t>(hash ^ (hash >> 31));
+			}
+		};
+
+		// Напечатанный ответ без значения request_id, которое
+		// вставляется в позицию id_pos при каждом ответе
+		struct PrintedAnswer {
+			std::string text;
+			size_t id_pos = 0;
+		};
+		// Готовые ответы для базы: обычный и компактный на каждое название
+		using StoredAnswers = std::vector<std::pair<PrintedAnswer, PrintedAnswer>>;
+
+		lru_cache::LruCache<RouteKey, std::shared_ptr<const PrintedAnswer>, RouteKeyHasher> route_cache_{ ROUTE_CACHE_CAPACITY };
+		// В базе есть готовые ответы Bus, Stop и Map (serialize::AnswerFragment)
+		bool stored_answers_ = false;
+		// Загружать базу целиком, а не только разделы, нужные запросам
+		// документа: запросы придут позже (serve, process_requests_stream)
+		bool load_whole_base_ = false;
+
+		static constexpr size_t STREAM_FLUSH_BATCH = 64;
+		static constexpr size_t PARALLEL_STAT_REQUESTS_THRESHOLD = 64;
+		static constexpr size_t ROUTE_CACHE_CAPACITY = 16384;
+		// make_base печатает готовые ответы кусками по ANSWER_CHUNK_SIZE названий
+		// и держит в памяти не больше ANSWER_CHUNKS_PER_THREAD кусков на поток
+		static constexpr size_t ANSWER_CHUNK_SIZE = 4096;
+		static constexpr size_t ANSWER_CHUNKS_PER_THREAD = 2;
 
 	public:
 		explicit JSONreader(serialize::Serialization& serializator,
@@ -28,19 +94,68 @@ namespace json_pro {
 			transport_router::TransportRouter& transport_router);
 
 		void LoadJSON( std::istream& input);
+		// make_delta: сравнивает справочник из input с базой serialization_settings.file
+		// и пишет отличия в serialization_settings.delta
+		void MakeDelta(std::istream& input);
 		void ReadRequests(std::istream& input);
 
-		void FillCatalogueStop( json::Document& doc);
-		void FillCatalogueBus( json::Document& doc);
-		void SetGraphInfo(const json::Dict& doc, transport_router::TransportRouter& router);
+		void FillCatalogueStop(const std::vector<request_schema::StopRequest>& stops);
+		void FillCatalogueBus(const std::vector<request_schema::BusRequest>& buses);
+		void SetGraphInfo(const request_schema::RoutingSettings& route_set, transport_router::TransportRouter& router);
+
+		void FillFromBaseRequests(const request_schema::RequestBatch& batch);
+		// Переставляет остановки пакета по batch.stop_order до заполнения
+		// справочника, где они получают номера, и передаёт перестановку в базу
+		void ReorderStops(request_schema::RequestBatch& batch);
+		void RenderMap(const request_schema::RequestBatch& batch);
+		void SerializeRoutingSettings(const request_schema::RequestBatch& batch);
 
+		void SetCompactOutput(bool compact);
+		void SetLoadWholeBase(bool whole);
+		// Разделы базы, нужные запросам batch_: готовые ответы, если они
+		// есть в базе, иначе данные, по которым ответ считается
+		uint32_t ChooseBaseSections(uint32_t available) const;
 		void PrintAnswer();
+		// Первая строка входа - настройки, как в process_requests; каждая следующая
+		// строка - один запрос, на который выводится одна строка компактного JSON.
+		// На строку, которую не удалось разобрать или обработать, выводится
+		// error_message с request_id или номером строки, и поток продолжается
+		void ProcessRequestStream(std::istream& input, std::ostream& output);
+		// Отвечает на пакет stat_requests по уже загруженной базе; после
+		// BuildRouter только читает общее состояние и может вызываться из разных потоков
+		std::string AnswerBatch(const request_schema::RequestBatch& batch);
+		void PrintAnswers(const std::vector<request_schema::StatRequest>& requests, std::ostream& output, bool compact, bool parallel);
+		json::Node Answer(const request_schema::StatRequest& request);
+		// Ответ, напечатанный как элемент массива ответов; пустая строка - ответа нет.
+		// Ответы Route между парами известных остановок берутся из кэша
+		std::string FormatAnswer(const request_schema::StatRequest& request, bool compact);
+		lru_cache::CacheStats GetRouteCacheStats() const;
+		// Печатает ответы на запросы Bus и Stop по названиям и карту и сохраняет
+		// их в базу, чтобы process_requests их не форматировал. make_base
+		// сохраняет ответы на все остановки и автобусы
+		void SerializeAnswerFragments(const std::vector<std::string_view>& stops, const std::vector<std::string_view>& buses, bool with_map);
+		// Печать только читает справочник и может идти параллельно с записью базы
+		StoredAnswers PrintStoredAnswers(request_schema::RequestType type, const std::vector<std::string_view>& names);
+		void SaveStoredAnswers(const StoredAnswers& stop_answers, const StoredAnswers& bus_answers, bool with_map);
+		// Названия в порядке остановок и автобусов справочника
+		std::vector<std::string_view> GetStopNames() const;
+		std::vector<std::string_view> GetBusNames() const;
+		std::optional<std::string> FormatStoredAnswer(const request_schema::StatRequest& request, bool compact);
+		// Маршрутизатор и карта строятся при первом запросе, которому они нужны,
+		// поэтому пакеты без Route и Map не платят за их построение
+		void BuildRouter();
+		// Запускает построение маршрутизатора в фоновом потоке; Route-запросы
+		// ждут его готовности через GetRouter, остальные отвечаются сразу
+		void StartRouterWarmUp();
+		const graph::Router<double>& GetRouter();
+		std::string_view GetMapRender();
 
-		std::filesystem::path DoSerialization(const json::Dict& queryset);
-		json::Dict PrintStop( const json::Node& node_map, int id);
-		json::Dict PrintBus( const json::Node& node_map, int id);
-		json::Dict PrintGraph( const json::Node& node_map, int id, graph::Router<double> transport_router, transport_router::TransportRouter router);
-		json::Dict PrintVisual(std::string result_map_render, int id);
+		std::filesystem::path DoSerialization(const std::string& file);
+		json::Node PrintStop(std::string_view stop_name, int id);
+		json::Node PrintBus(std::string_view bus_name, int id);
+		json::Node PrintGraph(std::string_view from, std::string_view to, int id, const graph::Router<double>& transport_router, const transport_router::TransportRouter& router);
+		json::Node PrintImageRoute(std::string_view from, std::string_view to, int id);
+		json::Node PrintVisual(std::string_view result_map_render, int id);
 	};
 }
 
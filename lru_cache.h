@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lru_cache {
+
+    struct CacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t size = 0;
+    };
+
+    // Ограниченный кэш с вытеснением давно не использованных записей.
+    // Ключи распределены по сегментам со своими мьютексами, поэтому потоки,
+    // обращающиеся к разным ключам, почти не ждут друг друга. Значения
+    // копируются при чтении - для больших значений храните shared_ptr.
+    template <typename Key, typename Value, typename Hash = std::hash<Key>>
+    class LruCache {
+    public:
+        explicit LruCache(size_t capacity, size_t shard_count = DEFAULT_SHARD_COUNT)
+            : shards_(std::max<size_t>(1, shard_count))
+            , shard_capacity_(std::max<size_t>(1, (capacity + shards_.size() - 1) / shards_.size())) {
+        }
+
+        std::optional<Value> Get(const Key& key) {
+            Shard& shard = GetShard(key);
+            std::lock_guard lock(shard.mutex);
+            const auto it = shard.index.find(key);
+            if (it == shard.index.end()) {
+                misses_.fetch_add(1, std::memory_order_relaxed);
+                return std::nullopt;
+            }
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            return it->second->second;
+        }
+
+        void Put(const Key& key, Value value) {
+            Shard& shard = GetShard(key);
+            std::lock_guard lock(shard.mutex);
+            if (const auto it = shard.index.find(key); it != shard.index.end()) {
+                it->second->second = std::move(value);
+                shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+                return;
+            }
+            shard.entries.emplace_front(key, std::move(value));
+            shard.index.emplace(key, shard.entries.begin());
+            if (shard.entries.size() > shard_capacity_) {
+                shard.index.erase(shard.entries.back().first);
+                shard.entries.pop_back();
+            }
+        }
+
+        CacheStats GetStats() const {
+            CacheStats stats;
+            stats.hits = hits_.load(std::memory_order_relaxed);
+            stats.misses = misses_.load(std::memory_order_relaxed);
+            for (const Shard& shard : shards_) {
+                std::lock_guard lock(shard.mutex);
+                stats.size += shard.entries.size();
+            }
+            return stats;
+        }
+
+    private:
+        static constexpr size_t DEFAULT_SHARD_COUNT = 16;
+
+        using Entries = std::list<std::pair<Key, Value>>;
+
+        struct Shard {
+            mutable std::mutex mutex;
+            Entries entries;
+            std::unordered_map<Key, typename Entries::iterator, Hash> index;
+        };
+
+        Shard& GetShard(const Key& key) {
+            return shards_[hasher_(key) % shards_.size()];
+        }
+
+        std::vector<Shard> shards_;
+        size_t shard_capacity_;
+        Hash hasher_;
+        std::atomic<uint64_t> hits_{ 0 };
+        std::atomic<uint64_t> misses_{ 0 };
+    };
+
+} // namespace lru_cache
@@ -8,21 +8,32 @@
 #include "graph.h"
 #include "router.h"
 #include "serialization.h"
+#include "query_server.h"
 
 using namespace std;
 using namespace std::literals;
 
 void PrintUsage(std::ostream& stream = std::cerr) {
-    stream << "Usage: transport_catalogue [make_base|process_requests]\n"sv;
+    stream << "Usage: transport_catalogue [make_base|make_delta|process_requests [--compact]|process_requests_stream|serve [socket_path]]\n"sv;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    if (argc < 2 || argc > 3) {
         PrintUsage();
         return 1;
     }
 
     const std::string_view mode(argv[1]);
+    bool compact_output = false;
+    if (argc == 3) {
+        if (mode == "process_requests"sv && argv[2] == "--compact"sv) {
+            compact_output = true;
+        }
+        else if (mode != "serve"sv) {
+            PrintUsage();
+            return 1;
+        }
+    }
 
     transport_db::TransportCatalogue catalogue;
     transport_router::TransportRouter router;
@@ -35,11 +46,31 @@ int main(int argc, char* argv[]) {
         json_reader.LoadJSON(std::cin);
 
     }
+    else if (mode == "make_delta"sv) {
+
+        json_reader.MakeDelta(std::cin);
+    }
     else if (mode == "process_requests"sv) {
 
+        json_reader.SetCompactOutput(compact_output);
         json_reader.ReadRequests(std::cin);
         json_reader.PrintAnswer();
     }
+    else if (mode == "process_requests_stream"sv) {
+
+        std::ios::sync_with_stdio(false);
+        json_reader.ProcessRequestStream(std::cin, std::cout);
+    }
+    else if (mode == "serve"sv) {
+
+        query_server::QueryServer server;
+        if (argc == 3) {
+            server.LoadBase(std::cin);
+            return server.ServeUnixSocket(argv[2]) ? 0 : 1;
+        }
+        std::ios::sync_with_stdio(false);
+        server.ServeStream(std::cin, std::cout);
+    }
     else {
         PrintUsage();
         return 1;
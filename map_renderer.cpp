@@ -17,26 +17,6 @@ namespace sphere
 
 namespace renderer
 {
-	RenderSettings::RenderSettings(const json::Dict& render_settings) {
-		width = render_settings.at("width").AsDouble();
-		height = render_settings.at("height").AsDouble();
-		padding = render_settings.at("padding").AsDouble();
-		line_width = render_settings.at("line_width").AsDouble();
-		stop_radius = render_settings.at("stop_radius").AsDouble();
-		bus_label_font_size = render_settings.at("bus_label_font_size").AsDouble();
-		bus_label_offset.lat = render_settings.at("bus_label_offset").AsArray().front().AsDouble();
-		bus_label_offset.lng = render_settings.at("bus_label_offset").AsArray().back().AsDouble();
-		stop_label_font_size = render_settings.at("stop_label_font_size").AsDouble();
-		stop_label_offset.lat = render_settings.at("stop_label_offset").AsArray().front().AsDouble();
-		stop_label_offset.lng = render_settings.at("stop_label_offset").AsArray().back().AsDouble();
-		underlayer_width = render_settings.at("underlayer_width").AsDouble();
-		underlayer_color = AddColor(render_settings.at("underlayer_color"));
-		for (const auto& color : render_settings.at("color_palette").AsArray())
-		{
-			color_palette.push_back(AddColor(color));
-		}
-	}
-
 	MapRenderer::MapRenderer(const RenderSettings& settings, transport_db::TransportCatalogue& t_c)
 		: render_settings_(settings)
 	{
@@ -46,38 +26,6 @@ namespace renderer
 		return svg::Color{ render_settings_.color_palette[index % render_settings_.color_palette.size()] };
 	}
 
-	svg::Color RenderSettings::AddColor(const json::Node& node)
-	{
-		{
-			svg::Color color;
-			if (node.IsArray())
-			{
-				if (node.AsArray().size() == 3)
-				{
-					svg::Rgb rgb;
-					rgb.red = node.AsArray()[0].AsInt();
-					rgb.green = node.AsArray()[1].AsInt();
-					rgb.blue = node.AsArray()[2].AsInt();
-					color = rgb;
-				}
-				if (node.AsArray().size() == 4)
-				{
-					svg::Rgba rgba;
-					rgba.red = node.AsArray()[0].AsInt();
-					rgba.green = node.AsArray()[1].AsInt();
-					rgba.blue = node.AsArray()[2].AsInt();
-					rgba.opacity = node.AsArray()[3].AsDouble();
-					color = rgba;
-				}
-			}
-			if (node.IsString())
-			{
-				color = node.AsString();
-			}
-			return color;
-		}
-	}
-
 	svg::Polyline MapRenderer::AddRoute(const domain::Bus& bus, const svg::Color& color)
 	{
 		svg::Polyline route_bus;
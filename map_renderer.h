@@ -1,7 +1,7 @@
 #pragma once
 
 #include "svg.h"
-#include "json_reader.h"
+#include "transport_catalogue.h"
 #include "geo.h"
 
 #include <algorithm>
@@ -10,6 +10,8 @@
 #include <optional>
 #include <vector>
 #include <tuple>
+#include <map>
+#include <string>
 
 namespace sphere
 {
@@ -113,7 +115,7 @@ namespace renderer
 
 	class RenderSettings {
 	public:
-		explicit RenderSettings(const json::Dict& render_settings);
+		RenderSettings() = default;
 
 		double width = 0.;
 		double height = 0.;
@@ -131,8 +133,6 @@ namespace renderer
 		double underlayer_width = 0.;
 
 		std::vector<svg::Color> color_palette{};
-
-		inline svg::Color AddColor(const json::Node& node);
 	};
 
 	class MapRenderer
@@ -0,0 +1,106 @@
+#include "query_protocol.h"
+
+#include <cctype>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace query_protocol {
+
+    namespace {
+        using namespace std::literals;
+
+        constexpr size_t MAX_FRAME_SIZE = size_t{ 1 } << 30;
+
+        size_t ParseFrameSize(std::string_view header) {
+            if (header.empty() || header.size() > 10) {
+                throw std::runtime_error("Bad frame header"s);
+            }
+            size_t size = 0;
+            for (const char c : header) {
+                if (!std::isdigit(static_cast<unsigned char>(c))) {
+                    throw std::runtime_error("Bad frame header"s);
+                }
+                size = size * 10 + static_cast<size_t>(c - '0');
+            }
+            if (size > MAX_FRAME_SIZE) {
+                throw std::runtime_error("Frame is too large"s);
+            }
+            return size;
+        }
+    } // namespace
+
+    bool ReadFrame(std::istream& input, std::string& payload) {
+        std::string header;
+        if (!std::getline(input, header)) {
+            return false;
+        }
+        payload.resize(ParseFrameSize(header));
+        return static_cast<bool>(input.read(payload.data(), static_cast<std::streamsize>(payload.size())));
+    }
+
+    void WriteFrame(std::ostream& output, std::string_view payload) {
+        output << payload.size() << '\n';
+        output.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        output.flush();
+    }
+
+#ifndef _WIN32
+    namespace {
+        bool ReadExactly(int fd, char* data, size_t size) {
+            while (size > 0) {
+                const ssize_t count = read(fd, data, size);
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count <= 0) {
+                    return false;
+                }
+                data += count;
+                size -= static_cast<size_t>(count);
+            }
+            return true;
+        }
+
+        bool WriteExactly(int fd, const char* data, size_t size) {
+            while (size > 0) {
+                const ssize_t count = write(fd, data, size);
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count <= 0) {
+                    return false;
+                }
+                data += count;
+                size -= static_cast<size_t>(count);
+            }
+            return true;
+        }
+    } // namespace
+
+    bool ReadFrame(int fd, std::string& payload) {
+        std::string header;
+        for (char c; ;) {
+            if (!ReadExactly(fd, &c, 1)) {
+                return false;
+            }
+            if (c == '\n') {
+                break;
+            }
+            header.push_back(c);
+        }
+        payload.resize(ParseFrameSize(header));
+        return ReadExactly(fd, payload.data(), payload.size());
+    }
+
+    bool WriteFrame(int fd, std::string_view payload) {
+        const std::string header = std::to_string(payload.size()) + '\n';
+        return WriteExactly(fd, header.data(), header.size())
+            && WriteExactly(fd, payload.data(), payload.size());
+    }
+#endif
+
+} // namespace query_protocol
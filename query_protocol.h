@@ -0,0 +1,21 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace query_protocol {
+
+    // Кадр протокола: длина полезной нагрузки десятичным числом, перевод строки,
+    // затем ровно столько байт нагрузки. Запрос - документ с stat_requests,
+    // ответ - JSON-массив ответов.
+
+    bool ReadFrame(std::istream& input, std::string& payload);
+    void WriteFrame(std::ostream& output, std::string_view payload);
+
+#ifndef _WIN32
+    bool ReadFrame(int fd, std::string& payload);
+    bool WriteFrame(int fd, std::string_view payload);
+#endif
+
+} // namespace query_protocol
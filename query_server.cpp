@@ -0,0 +1,281 @@
+#include "query_server.h"
+#include "query_protocol.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#endif
+
+namespace query_server {
+
+    using namespace std::literals;
+
+    QueryServer::~QueryServer() {
+        {
+            std::lock_guard lock(watcher_mutex_);
+            stopped_ = true;
+        }
+        watcher_stop_.notify_all();
+        if (watcher_.joinable()) {
+            watcher_.join();
+        }
+    }
+
+    QueryServer::FileTimes QueryServer::GetFileTimes(const std::vector<std::filesystem::path>& files) {
+        FileTimes times;
+        for (const auto& file : files) {
+            std::error_code error;
+            const auto time = std::filesystem::last_write_time(file, error);
+            times.push_back(error ? std::nullopt : std::optional(time));
+        }
+        return times;
+    }
+
+    std::shared_ptr<QueryServer::Snapshot> QueryServer::LoadSnapshot(const std::string& settings) {
+        auto snapshot = std::make_shared<Snapshot>();
+        std::istringstream settings_input(settings);
+        const request_schema::RequestBatch batch = request_schema::DecodeRequests(settings_input, false);
+        for (const auto& file : { batch.serialization_file, batch.image_file, batch.delta_file }) {
+            if (file) {
+                // Отсутствующая база не должна подменить рабочую пустым справочником
+                if (!std::filesystem::is_regular_file(*file)) {
+                    throw std::runtime_error("Base file not found: "s + *file);
+                }
+                snapshot->base_files.emplace_back(*file);
+            }
+        }
+        // Время берётся до чтения: изменение во время загрузки вызовет ещё одну
+        snapshot->base_file_times = GetFileTimes(snapshot->base_files);
+
+        settings_input.clear();
+        settings_input.seekg(0);
+        snapshot->reader.SetLoadWholeBase(true);
+        snapshot->reader.ReadRequests(settings_input);
+        snapshot->reader.BuildRouter();
+        snapshot->reader.GetMapRender();
+        return snapshot;
+    }
+
+    std::shared_ptr<QueryServer::Snapshot> QueryServer::GetSnapshot() const {
+        return std::atomic_load(&snapshot_);
+    }
+
+    void QueryServer::LoadBase(std::istream& settings) {
+        Reload(std::string(std::istreambuf_iterator<char>(settings), std::istreambuf_iterator<char>()));
+    }
+
+    void QueryServer::Reload(const std::string& settings) {
+        // Загрузки идут по одной; ответы в это время читают текущий снимок
+        std::lock_guard lock(reload_mutex_);
+        const std::string& source = settings.empty() ? settings_ : settings;
+        std::shared_ptr<Snapshot> snapshot = LoadSnapshot(source);
+        settings_ = source;
+        std::atomic_store(&snapshot_, std::move(snapshot));
+    }
+
+    std::string QueryServer::AnswerFrame(const std::string& payload) {
+        std::istringstream input(payload);
+        try {
+            const request_schema::RequestBatch batch = request_schema::DecodeRequests(input, false);
+            if (batch.reload) {
+                // Снимок строится в потоке наблюдателя, ответы тем временем
+                // идут по текущему
+                const bool has_settings = batch.serialization_file || batch.image_file;
+                RequestReload(has_settings ? payload : std::string{});
+                return json::PrintArrayItem(json::Builder{}
+                    .StartDict()
+                    .Key("reload_scheduled"s).Value(true)
+                    .EndDict()
+                    .Build(), true);
+            }
+            // Снимок удерживается до конца пакета, даже если его уже заменили
+            const std::shared_ptr<Snapshot> snapshot = GetSnapshot();
+            if (batch.cache_stats) {
+                const lru_cache::CacheStats stats = snapshot->reader.GetRouteCacheStats();
+                const auto to_int = [](uint64_t value) {
+                    return static_cast<int>(std::min<uint64_t>(value, std::numeric_limits<int>::max()));
+                };
+                return json::PrintArrayItem(json::Builder{}
+                    .StartDict()
+                    .Key("route_cache"s).StartDict()
+                    .Key("hits"s).Value(to_int(stats.hits))
+                    .Key("misses"s).Value(to_int(stats.misses))
+                    .Key("size"s).Value(to_int(stats.size))
+                    .EndDict()
+                    .EndDict()
+                    .Build(), true);
+            }
+            return snapshot->reader.AnswerBatch(batch);
+        }
+        catch (const std::exception& e) {
+            return json::PrintArrayItem(json::Builder{}
+                .StartDict()
+                .Key("error_message"s).Value(std::string(e.what()))
+                .EndDict()
+                .Build(), true);
+        }
+    }
+
+    void QueryServer::StartWatching() {
+        if (!watcher_.joinable()) {
+            watcher_ = std::thread([this] {
+                WatchBaseFiles();
+            });
+        }
+    }
+
+    void QueryServer::RequestReload(std::string settings) {
+        StartWatching();
+        {
+            std::lock_guard lock(watcher_mutex_);
+            requested_reload_ = std::move(settings);
+        }
+        watcher_stop_.notify_all();
+    }
+
+    void QueryServer::WatchBaseFiles() {
+        FileTimes previous;
+        FileTimes failed;
+        std::unique_lock lock(watcher_mutex_);
+        while (true) {
+            watcher_stop_.wait_for(lock, RELOAD_POLL_INTERVAL, [this] { return stopped_ || requested_reload_.has_value(); });
+            if (stopped_) {
+                break;
+            }
+            const std::optional<std::string> requested = std::exchange(requested_reload_, std::nullopt);
+            lock.unlock();
+            auto try_reload = [this](const std::string& settings) {
+                try {
+                    Reload(settings);
+                    std::cerr << "Base reloaded\n"sv;
+                    return true;
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Base reload failed: "sv << e.what() << '\n';
+                    return false;
+                }
+            };
+            if (requested) {
+                try_reload(*requested);
+            }
+            const std::shared_ptr<Snapshot> snapshot = GetSnapshot();
+            const FileTimes times = GetFileTimes(snapshot->base_files);
+            // Файл перезагружается, когда он изменился и не менялся с прошлой проверки,
+            // чтобы не читать базу, которую ещё дописывают
+            if (times != snapshot->base_file_times && times == previous && times != failed) {
+                if (!try_reload({})) {
+                    failed = times;
+                }
+            }
+            previous = times;
+            lock.lock();
+        }
+    }
+
+    void QueryServer::ServeStream(std::istream& input, std::ostream& output) {
+        std::string settings;
+        if (!query_protocol::ReadFrame(input, settings)) {
+            return;
+        }
+        std::istringstream settings_input(settings);
+        LoadBase(settings_input);
+        StartWatching();
+
+        for (std::string payload; query_protocol::ReadFrame(input, payload);) {
+            query_protocol::WriteFrame(output, AnswerFrame(payload));
+        }
+    }
+
+#ifndef _WIN32
+    bool QueryServer::ServeUnixSocket(const std::string& socket_path) {
+        sockaddr_un address{};
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Socket path is too long\n"sv;
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+
+        const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            std::cerr << "socket: "sv << std::strerror(errno) << '\n';
+            return false;
+        }
+        unlink(socket_path.c_str());
+        if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+            || listen(listen_fd, SOMAXCONN) < 0) {
+            std::cerr << "bind/listen: "sv << std::strerror(errno) << '\n';
+            close(listen_fd);
+            return false;
+        }
+        // Клиент, закрывший соединение до ответа, не должен завершать сервер
+        std::signal(SIGPIPE, SIG_IGN);
+        StartWatching();
+
+        // Соединение читается своим потоком и не занимает воркер пула, пока
+        // клиент молчит; в пул уходят только ответы на пришедшие пакеты
+        thread_pool::ThreadPool pool;
+        std::mutex connections_mutex;
+        std::condition_variable connections_closed;
+        size_t connections = 0;
+        while (true) {
+            const int client_fd = accept(listen_fd, nullptr, nullptr);
+            if (client_fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "accept: "sv << std::strerror(errno) << '\n';
+                break;
+            }
+            {
+                std::lock_guard lock(connections_mutex);
+                ++connections;
+            }
+            std::thread([&, client_fd] {
+                try {
+                    for (std::string payload; query_protocol::ReadFrame(client_fd, payload);) {
+                        const std::string answer = pool.Submit([this, &payload] {
+                            return AnswerFrame(payload);
+                        }).get();
+                        if (!query_protocol::WriteFrame(client_fd, answer)) {
+                            break;
+                        }
+                    }
+                }
+                catch (const std::exception& e) {
+                    std::cerr << e.what() << '\n';
+                }
+                close(client_fd);
+                std::lock_guard lock(connections_mutex);
+                --connections;
+                connections_closed.notify_all();
+            }).detach();
+        }
+        // Пул и счётчик живут на стеке: дожидаемся открытых соединений
+        std::unique_lock lock(connections_mutex);
+        connections_closed.wait(lock, [&connections] {
+            return connections == 0;
+        });
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        return false;
+    }
+#else
+    bool QueryServer::ServeUnixSocket(const std::string&) {
+        std::cerr << "Unix sockets are not supported on this platform\n"sv;
+        return false;
+    }
+#endif
+
+} // namespace query_server
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "json_reader.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace query_server {
+
+    // Долгоживущий обработчик запросов: база и маршрутизатор загружаются один раз,
+    // после чего пакеты запросов обслуживаются по кадровому протоколу query_protocol.
+    //
+    // Новую базу можно подменить без остановки: кадр {"reload": true} (при желании
+    // с новыми serialization_settings) или замена файла базы на диске загружают
+    // новый снимок в потоке наблюдателя, после чего он атомарно заменяет текущий.
+    // На кадр reload сразу приходит {"reload_scheduled": true}, ошибки загрузки
+    // пишутся в stderr. Пакеты, начатые на старом снимке, дорабатывают на нём.
+    //
+    // Кадр {"cache_stats": true} возвращает счётчики кэша ответов Route текущего снимка.
+    class QueryServer {
+    public:
+        QueryServer() = default;
+        QueryServer(const QueryServer&) = delete;
+        QueryServer& operator=(const QueryServer&) = delete;
+        ~QueryServer();
+
+        // Читает документ настроек (serialization_settings), загружает базу
+        // и строит маршрутизатор
+        void LoadBase(std::istream& settings);
+
+        // Загружает новый снимок базы и подменяет им текущий. Пустые настройки -
+        // перечитать базу по прежним. При ошибке загрузки остаётся старый снимок.
+        void Reload(const std::string& settings = {});
+
+        // Первый кадр из input - документ настроек, по нему загружается база;
+        // затем на каждый кадр с запросами в output пишется кадр с ответом
+        void ServeStream(std::istream& input, std::ostream& output);
+
+        // Принимает соединения на Unix-сокете; каждое соединение читается своим
+        // потоком, а пакеты запросов отвечаются в пуле потоков. Возвращает false,
+        // если сокет открыть не удалось.
+        bool ServeUnixSocket(const std::string& socket_path);
+
+    private:
+        using FileTimes = std::vector<std::optional<std::filesystem::file_time_type>>;
+
+        // Загруженная база со всем, что нужно для ответов. После загрузки
+        // только читается и живёт, пока на неё ссылается хотя бы один пакет
+        struct Snapshot {
+            transport_db::TransportCatalogue catalogue;
+            transport_router::TransportRouter router;
+            serialize::Serialization serializator{ catalogue };
+            json_pro::JSONreader reader{ serializator, catalogue, {}, router };
+            // Файлы базы и время их изменения на момент загрузки
+            std::vector<std::filesystem::path> base_files;
+            FileTimes base_file_times;
+        };
+
+        static FileTimes GetFileTimes(const std::vector<std::filesystem::path>& files);
+        static std::shared_ptr<Snapshot> LoadSnapshot(const std::string& settings);
+        std::shared_ptr<Snapshot> GetSnapshot() const;
+        std::string AnswerFrame(const std::string& payload);
+
+        // Передаёт перезагрузку по настройкам settings потоку наблюдателя
+        void RequestReload(std::string settings);
+
+        // Раз в RELOAD_POLL_INTERVAL проверяет время изменения файлов базы
+        // и перезагружает её, когда файл поменялся и перестал меняться;
+        // выполняет перезагрузки, запрошенные через RequestReload
+        void StartWatching();
+        void WatchBaseFiles();
+
+        static constexpr std::chrono::seconds RELOAD_POLL_INTERVAL{ 1 };
+
+        std::shared_ptr<Snapshot> snapshot_;
+        std::string settings_;
+        std::mutex reload_mutex_;
+
+        std::thread watcher_;
+        std::mutex watcher_mutex_;
+        std::condition_variable watcher_stop_;
+        bool stopped_ = false;
+        // Последние ещё не выполненные настройки перезагрузки
+        std::optional<std::string> requested_reload_;
+    };
+
+} // namespace query_server
@@ -0,0 +1,382 @@
+#include "request_schema.h"
+
+#include <algorithm>
+#include <future>
+#include <iterator>
+#include <thread>
+
+namespace request_schema {
+
+    namespace {
+        using namespace std::literals;
+
+        enum RootKey { SERIALIZATION_SETTINGS, ROUTING_SETTINGS, RENDER_SETTINGS, BASE_REQUESTS, STAT_REQUESTS, OUTPUT_SETTINGS, RELOAD, CACHE_STATS };
+        constexpr KeyIndex<8> ROOT_KEYS(std::array{
+            "serialization_settings"sv, "routing_settings"sv, "render_settings"sv,
+            "base_requests"sv, "stat_requests"sv, "output_settings"sv, "reload"sv, "cache_stats"sv });
+
+        enum BaseKey { BASE_TYPE, BASE_NAME, LATITUDE, LONGITUDE, ROAD_DISTANCES, STOPS, IS_ROUNDTRIP };
+        constexpr KeyIndex<7> BASE_KEYS(std::array{
+            "type"sv, "name"sv, "latitude"sv, "longitude"sv,
+            "road_distances"sv, "stops"sv, "is_roundtrip"sv });
+
+        enum StatKey { STAT_ID, STAT_TYPE, STAT_NAME, FROM, TO };
+        constexpr KeyIndex<5> STAT_KEYS(std::array{
+            "id"sv, "type"sv, "name"sv, "from"sv, "to"sv });
+
+        constexpr KeyIndex<4> TYPE_NAMES(std::array{
+            "Bus"sv, "Stop"sv, "Route"sv, "Map"sv });
+
+        enum RenderKey {
+            WIDTH, HEIGHT, PADDING, LINE_WIDTH, STOP_RADIUS,
+            BUS_LABEL_FONT_SIZE, BUS_LABEL_OFFSET, STOP_LABEL_FONT_SIZE, STOP_LABEL_OFFSET,
+            UNDERLAYER_COLOR, UNDERLAYER_WIDTH, COLOR_PALETTE
+        };
+        constexpr KeyIndex<12> RENDER_KEYS(std::array{
+            "width"sv, "height"sv, "padding"sv, "line_width"sv, "stop_radius"sv,
+            "bus_label_font_size"sv, "bus_label_offset"sv, "stop_label_font_size"sv, "stop_label_offset"sv,
+            "underlayer_color"sv, "underlayer_width"sv, "color_palette"sv });
+
+        enum RoutingKey { BUS_WAIT_TIME, BUS_VELOCITY };
+        constexpr KeyIndex<2> ROUTING_KEYS(std::array{ "bus_wait_time"sv, "bus_velocity"sv });
+
+        enum SerializationKey { FILE_NAME, IMAGE, FORMAT, COMPRESSION, DELTA, STOP_ORDER };
+        constexpr KeyIndex<6> SERIALIZATION_KEYS(std::array{
+            "file"sv, "image"sv, "format"sv, "compression"sv, "delta"sv, "stop_order"sv });
+
+        // Порядок совпадает с номерами stop_order::StopOrder
+        constexpr KeyIndex<3> STOP_ORDER_NAMES(std::array{
+            "input"sv, "hilbert"sv, "rcm"sv });
+
+        RequestType ToRequestType(std::string_view type) {
+            const int index = TYPE_NAMES.Find(type);
+            return index < 0 ? RequestType::UNKNOWN : static_cast<RequestType>(index);
+        }
+
+        geo::Coordinates DecodeOffset(json::Reader& reader) {
+            geo::Coordinates offset{ 0.0, 0.0 };
+            reader.BeginArray();
+            if (reader.NextItem()) {
+                offset.lat = reader.ReadDouble();
+            }
+            if (reader.NextItem()) {
+                offset.lng = reader.ReadDouble();
+            }
+            while (reader.NextItem()) {
+                reader.SkipValue();
+            }
+            return offset;
+        }
+
+        svg::Color DecodeColor(json::Reader& reader) {
+            if (reader.Peek() == '"') {
+                return std::string(reader.ReadString());
+            }
+            std::vector<json::Node> components;
+            reader.BeginArray();
+            while (reader.NextItem()) {
+                components.push_back(reader.ReadNumber());
+            }
+            if (components.size() == 3) {
+                return svg::Rgb(components[0].AsInt(), components[1].AsInt(), components[2].AsInt());
+            }
+            if (components.size() == 4) {
+                return svg::Rgba(components[0].AsInt(), components[1].AsInt(), components[2].AsInt(), components[3].AsDouble());
+            }
+            return svg::Color{};
+        }
+
+        renderer::RenderSettings DecodeRenderSettings(json::Reader& reader) {
+            renderer::RenderSettings settings;
+            reader.BeginDict();
+            while (const auto key = reader.NextKey()) {
+                switch (RENDER_KEYS.Find(*key)) {
+                case WIDTH:
+                    settings.width = reader.ReadDouble();
+                    break;
+                case HEIGHT:
+                    settings.height = reader.ReadDouble();
+                    break;
+                case PADDING:
+                    settings.padding = reader.ReadDouble();
+                    break;
+                case LINE_WIDTH:
+                    settings.line_width = reader.ReadDouble();
+                    break;
+                case STOP_RADIUS:
+                    settings.stop_radius = reader.ReadDouble();
+                    break;
+                case BUS_LABEL_FONT_SIZE:
+                    settings.bus_label_font_size = reader.ReadDouble();
+                    break;
+                case BUS_LABEL_OFFSET:
+                    settings.bus_label_offset = DecodeOffset(reader);
+                    break;
+                case STOP_LABEL_FONT_SIZE:
+                    settings.stop_label_font_size = reader.ReadDouble();
+                    break;
+                case STOP_LABEL_OFFSET:
+                    settings.stop_label_offset = DecodeOffset(reader);
+                    break;
+                case UNDERLAYER_COLOR:
+                    settings.underlayer_color = DecodeColor(reader);
+                    break;
+                case UNDERLAYER_WIDTH:
+                    settings.underlayer_width = reader.ReadDouble();
+                    break;
+                case COLOR_PALETTE:
+                    reader.BeginArray();
+                    while (reader.NextItem()) {
+                        settings.color_palette.push_back(DecodeColor(reader));
+                    }
+                    break;
+                default:
+                    reader.SkipValue();
+                }
+            }
+            return settings;
+        }
+
+        RoutingSettings DecodeRoutingSettings(json::Reader& reader) {
+            RoutingSettings settings;
+            reader.BeginDict();
+            while (const auto key = reader.NextKey()) {
+                switch (ROUTING_KEYS.Find(*key)) {
+                case BUS_WAIT_TIME:
+                    settings.bus_wait_time = reader.ReadInt();
+                    break;
+                case BUS_VELOCITY:
+                    settings.bus_velocity = reader.ReadDouble();
+                    break;
+                default:
+                    reader.SkipValue();
+                }
+            }
+            return settings;
+        }
+
+        // Массивы base_requests меньше этого размера разбираются в одном потоке
+        constexpr size_t PARALLEL_BASE_REQUESTS_THRESHOLD = 4096;
+
+        struct BaseRequests {
+            std::vector<StopRequest> stops;
+            std::vector<BusRequest> buses;
+        };
+
+        // Запрос Stop или Bus: тип может встретиться после остальных полей,
+        // поэтому поля обоих видов читаются в одну запись
+        void DecodeBaseRequest(json::Reader& reader, BaseRequests& requests) {
+            RequestType type = RequestType::UNKNOWN;
+            StopRequest stop;
+            BusRequest bus;
+            reader.BeginDict();
+            while (const auto key = reader.NextKey()) {
+                switch (BASE_KEYS.Find(*key)) {
+                case BASE_TYPE:
+                    type = ToRequestType(reader.ReadString());
+                    break;
+                case BASE_NAME:
+                    stop.name = bus.name = reader.ReadString();
+                    break;
+                case LATITUDE:
+                    stop.coordinates.lat = reader.ReadDouble();
+                    break;
+                case LONGITUDE:
+                    stop.coordinates.lng = reader.ReadDouble();
+                    break;
+                case ROAD_DISTANCES:
+                    reader.BeginDict();
+                    while (const auto to = reader.NextKey()) {
+                        stop.road_distances.emplace_back(*to, reader.ReadInt());
+                    }
+                    break;
+                case STOPS:
+                    reader.BeginArray();
+                    while (reader.NextItem()) {
+                        bus.stops.push_back(reader.ReadString());
+                    }
+                    break;
+                case IS_ROUNDTRIP:
+                    bus.is_roundtrip = reader.ReadBool();
+                    break;
+                default:
+                    reader.SkipValue();
+                }
+            }
+            if (type == RequestType::STOP) {
+                requests.stops.push_back(std::move(stop));
+            }
+            else if (type == RequestType::BUS) {
+                requests.buses.push_back(std::move(bus));
+            }
+        }
+
+        // Делит массив на элементы быстрым проходом по скобкам и кавычкам,
+        // разбирает куски в отдельных потоках и склеивает результаты по порядку
+        void DecodeBaseRequests(json::Reader& reader, RequestBatch& batch) {
+            const std::vector<std::string_view> items = reader.SplitArray();
+            const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+            const size_t chunk_count = items.size() < PARALLEL_BASE_REQUESTS_THRESHOLD ? 1 : threads;
+            const size_t chunk_size = (items.size() + chunk_count - 1) / chunk_count;
+
+            std::vector<std::future<BaseRequests>> chunks;
+            for (size_t begin = 0; begin < items.size(); begin += chunk_size) {
+                const size_t end = std::min(items.size(), begin + chunk_size);
+                json::Reader& chunk_reader = *batch.readers.emplace_back(std::make_unique<json::Reader>(std::string_view{}));
+                auto decode = [&items, &chunk_reader, begin, end] {
+                    BaseRequests requests;
+                    for (size_t i = begin; i < end; ++i) {
+                        chunk_reader.Reset(items[i]);
+                        DecodeBaseRequest(chunk_reader, requests);
+                    }
+                    return requests;
+                };
+                chunks.push_back(std::async(chunk_count == 1 ? std::launch::deferred : std::launch::async, decode));
+            }
+
+            for (auto& chunk : chunks) {
+                BaseRequests requests = chunk.get();
+                std::move(requests.stops.begin(), requests.stops.end(), std::back_inserter(batch.stops));
+                std::move(requests.buses.begin(), requests.buses.end(), std::back_inserter(batch.buses));
+            }
+        }
+
+        void DecodeSerializationSettings(json::Reader& reader, RequestBatch& batch) {
+            reader.BeginDict();
+            while (const auto key = reader.NextKey()) {
+                switch (SERIALIZATION_KEYS.Find(*key)) {
+                case FILE_NAME:
+                    batch.serialization_file = std::string(reader.ReadString());
+                    break;
+                case IMAGE:
+                    batch.image_file = std::string(reader.ReadString());
+                    break;
+                case FORMAT: {
+                    const std::string_view format = reader.ReadString();
+                    if (format != "flat"sv && format != "protobuf"sv) {
+                        throw json::ParsingError("Unknown format '"s + std::string(format) + "'"s);
+                    }
+                    batch.flat_format = format == "flat"sv;
+                    break;
+                }
+                case COMPRESSION: {
+                    const std::string_view compression = reader.ReadString();
+                    if (compression != "lz"sv) {
+                        throw json::ParsingError("Unknown compression '"s + std::string(compression) + "'"s);
+                    }
+                    batch.compress_base = true;
+                    break;
+                }
+                case DELTA:
+                    batch.delta_file = std::string(reader.ReadString());
+                    break;
+                case STOP_ORDER: {
+                    const std::string_view order = reader.ReadString();
+                    const int index = STOP_ORDER_NAMES.Find(order);
+                    if (index < 0) {
+                        throw json::ParsingError("Unknown stop_order '"s + std::string(order) + "'"s);
+                    }
+                    batch.stop_order = static_cast<stop_order::StopOrder>(index);
+                    break;
+                }
+                default:
+                    reader.SkipValue();
+                }
+            }
+        }
+
+        bool DecodeCompactOutput(json::Reader& reader) {
+            bool compact = false;
+            reader.BeginDict();
+            while (const auto key = reader.NextKey()) {
+                if (*key == "compact"sv) {
+                    compact = reader.ReadBool();
+                }
+                else {
+                    reader.SkipValue();
+                }
+            }
+            return compact;
+        }
+    } // namespace
+
+    StatRequest DecodeStatRequest(json::Reader& reader) {
+        StatRequest request;
+        reader.BeginDict();
+        while (const auto key = reader.NextKey()) {
+            switch (STAT_KEYS.Find(*key)) {
+            case STAT_ID:
+                request.id = reader.ReadInt();
+                break;
+            case STAT_TYPE:
+                request.type = ToRequestType(reader.ReadString());
+                break;
+            case STAT_NAME:
+                request.name = reader.ReadString();
+                break;
+            case FROM:
+                request.from = reader.ReadString();
+                break;
+            case TO:
+                request.to = reader.ReadString();
+                break;
+            default:
+                reader.SkipValue();
+            }
+        }
+        return request;
+    }
+
+    RequestBatch DecodeRequests(std::istream& input, bool decode_base_data) {
+        RequestBatch batch;
+        batch.source = std::make_unique<const std::string>(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+        json::Reader& reader = *batch.readers.emplace_back(std::make_unique<json::Reader>(*batch.source));
+
+        reader.BeginDict();
+        while (const auto key = reader.NextKey()) {
+            switch (ROOT_KEYS.Find(*key)) {
+            case SERIALIZATION_SETTINGS:
+                DecodeSerializationSettings(reader, batch);
+                break;
+            case ROUTING_SETTINGS:
+                batch.routing_settings = DecodeRoutingSettings(reader);
+                break;
+            case RENDER_SETTINGS:
+                if (decode_base_data) {
+                    batch.render_settings = DecodeRenderSettings(reader);
+                }
+                else {
+                    reader.SkipValue();
+                }
+                break;
+            case BASE_REQUESTS:
+                if (decode_base_data) {
+                    DecodeBaseRequests(reader, batch);
+                }
+                else {
+                    reader.SkipValue();
+                }
+                break;
+            case STAT_REQUESTS:
+                reader.BeginArray();
+                while (reader.NextItem()) {
+                    batch.stat_requests.push_back(DecodeStatRequest(reader));
+                }
+                break;
+            case OUTPUT_SETTINGS:
+                batch.compact_output = DecodeCompactOutput(reader);
+                break;
+            case RELOAD:
+                batch.reload = reader.ReadBool();
+                break;
+            case CACHE_STATS:
+                batch.cache_stats = reader.ReadBool();
+                break;
+            default:
+                reader.SkipValue();
+            }
+        }
+        return batch;
+    }
+
+} // namespace request_schema
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "json.h"
+#include "geo.h"
+#include "map_renderer.h"
+#include "stop_order.h"
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace request_schema {
+
+    constexpr uint32_t HashKey(std::string_view key, uint32_t seed) {
+        uint32_t hash = 2166136261u ^ seed;
+        for (const char c : key) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
+        }
+        // Перемешивание, чтобы зерно влияло и на младшие биты
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6bu;
+        hash ^= hash >> 13;
+        return hash;
+    }
+
+    // Совершенная хеш-функция для фиксированного набора ключей схемы.
+    // Зерно подбирается при компиляции так, чтобы ключи не давали коллизий;
+    // Find возвращает индекс ключа в исходном массиве или -1 для чужого ключа.
+    template <size_t N>
+    class KeyIndex {
+    public:
+        constexpr explicit KeyIndex(const std::array<std::string_view, N>& keys)
+            : keys_(keys) {
+            while (!TrySeed(seed_)) {
+                if (++seed_ == MAX_SEED) {
+                    throw std::logic_error("No perfect hash seed for the key set");
+                }
+            }
+        }
+
+        constexpr int Find(std::string_view key) const {
+            const int index = slots_[HashKey(key, seed_) & (TABLE_SIZE - 1)];
+            return (index >= 0 && keys_[index] == key) ? index : -1;
+        }
+
+    private:
+        static constexpr size_t TableSize() {
+            size_t size = 1;
+            while (size < 2 * N) {
+                size *= 2;
+            }
+            return size;
+        }
+
+        static constexpr size_t TABLE_SIZE = TableSize();
+        static constexpr uint32_t MAX_SEED = 100000;
+
+        constexpr bool TrySeed(uint32_t seed) {
+            for (auto& slot : slots_) {
+                slot = -1;
+            }
+            for (size_t i = 0; i < N; ++i) {
+                auto& slot = slots_[HashKey(keys_[i], seed) & (TABLE_SIZE - 1)];
+                if (slot >= 0) {
+                    return false;
+                }
+                slot = static_cast<int>(i);
+            }
+            return true;
+        }
+
+        std::array<std::string_view, N> keys_{};
+        std::array<int, TABLE_SIZE> slots_{};
+        uint32_t seed_ = 0;
+    };
+
+    enum class RequestType {
+        BUS,
+        STOP,
+        ROUTE,
+        MAP,
+        UNKNOWN,
+    };
+
+    struct StopRequest {
+        std::string_view name;
+        geo::Coordinates coordinates{ 0.0, 0.0 };
+        std::vector<std::pair<std::string_view, int>> road_distances;
+    };
+
+    struct BusRequest {
+        std::string_view name;
+        std::vector<std::string_view> stops;
+        bool is_roundtrip = false;
+    };
+
+    struct StatRequest {
+        int id = 0;
+        RequestType type = RequestType::UNKNOWN;
+        std::string_view name;
+        std::string_view from;
+        std::string_view to;
+    };
+
+    struct RoutingSettings {
+        int bus_wait_time = 0;
+        double bus_velocity = 0.0;
+    };
+
+    // Разобранный пакет запросов. Строковые поля ссылаются на исходный текст
+    // и на хранилище читателя, поэтому пакет владеет обоими.
+    struct RequestBatch {
+        std::unique_ptr<const std::string> source;
+        std::vector<std::unique_ptr<json::Reader>> readers;
+
+        std::optional<std::string> serialization_file;
+        // Образ справочника для отображения в память (catalogue_image)
+        std::optional<std::string> image_file;
+        // serialization_settings.format = "flat": make_base пишет базу
+        // в файл file сразу в формате образа; "protobuf" (по умолчанию) - обычная база
+        bool flat_format = false;
+        // serialization_settings.compression = "lz": база сжимается блочным LZ
+        bool compress_base = false;
+        // serialization_settings.delta: файл изменений, который make_delta пишет
+        // относительно базы file, а process_requests применяет к ней
+        std::optional<std::string> delta_file;
+        // serialization_settings.stop_order = "input" (по умолчанию), "hilbert" или "rcm":
+        // нумерация остановок в make_base (stop_order::StopOrder)
+        stop_order::StopOrder stop_order = stop_order::StopOrder::INPUT;
+        std::optional<RoutingSettings> routing_settings;
+        std::optional<renderer::RenderSettings> render_settings;
+        std::vector<StopRequest> stops;
+        std::vector<BusRequest> buses;
+        std::vector<StatRequest> stat_requests;
+        bool compact_output = false;
+        // Команда долгоживущему серверу перечитать базу
+        bool reload = false;
+        // Запрос счётчиков кэша ответов у долгоживущего сервера
+        bool cache_stats = false;
+    };
+
+    // Разбирает документ запросов сразу в типизированные структуры, без DOM.
+    // Неизвестные разделы и ключи пропускаются. При decode_base_data = false
+    // разделы render_settings и base_requests только просматриваются
+    // (Reader::SkipValue): справочник и карта в этом случае берутся из базы.
+    RequestBatch DecodeRequests(std::istream& input, bool decode_base_data = true);
+
+    StatRequest DecodeStatRequest(json::Reader& reader);
+
+} // namespace request_schema
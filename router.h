@@ -33,12 +33,17 @@ namespace graph {
             return graph_;
         }
 
-
-    private:
         struct RouteInternalData {
             Weight weight;
             std::optional<EdgeId> prev_edge;
         };
+
+        // Предвычисленная запись о кратчайшем пути, для сохранения таблиц маршрутизатора
+        const std::optional<RouteInternalData>& GetRouteInternalData(VertexId from, VertexId to) const {
+            return routes_internal_data_.at(from).at(to);
+        }
+
+    private:
         using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
 
         void InitializeRoutesInternalData(const Graph& graph) {
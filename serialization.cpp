@@ -1,106 +1,564 @@
 #include <cstdint>
 #include <fstream>
+#include <future>
 #include <sstream>
 #include <utility>
 #include <variant>
 #include <algorithm>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+
+#include <google/protobuf/io/coded_stream.h>
 
 #include "serialization.h"
 #include "transport_catalogue.pb.h"
 #include "map_renderer.pb.h"
 #include "geo.h"
+#include "catalogue_image.h"
+#include "base_codec.h"
+#include "thread_pool.h"
 
 namespace serialize {
 
+    namespace {
+        constexpr int TRANSPORT_BASE_FIELD = proto_catalogue::TransportCatalogue::kTransportBaseFieldNumber;
+        constexpr int MAP_REN_FIELD = proto_catalogue::TransportCatalogue::kMapRenFieldNumber;
+        constexpr int ROUTER_SET_FIELD = proto_catalogue::TransportCatalogue::kRouterSetFieldNumber;
+        constexpr int ANSWERS_FIELD = proto_catalogue::TransportCatalogue::kAnswersFieldNumber;
+        constexpr int CONTENTS_FIELD = proto_catalogue::TransportCatalogue::kContentsFieldNumber;
+        // Последнее поле файла - contents_offset (fixed64): тег и 8 байт
+        constexpr unsigned char CONTENTS_OFFSET_TAG = proto_catalogue::TransportCatalogue::kContentsOffsetFieldNumber << 3 | 1;
+        constexpr uint64_t TRAILER_SIZE = 9;
+        // Раздел, загружаемый всегда
+        constexpr uint32_t ALWAYS_LOADED = 0;
+        // Примерный размер куска, разбираемого одной задачей
+        constexpr size_t PARSE_PIECE_SIZE = 256 * 1024;
+
+        // Пропускает поле сообщения в wire-формате, начинающееся с pos.
+        // Возвращает номер поля; value - значение поля с разделителем длины
+        uint32_t SkipField(std::string_view message, size_t& pos, std::string_view& value) {
+            const uint64_t tag = base_codec::ReadVarint(message, pos);
+            const size_t value_begin = pos;
+            size_t size = 0;
+            switch (tag & 7) {
+            case 0:
+                base_codec::ReadVarint(message, pos);
+                break;
+            case 1:
+                size = 8;
+                break;
+            case 2:
+                size = base_codec::ReadVarint(message, pos);
+                break;
+            case 5:
+                size = 4;
+                break;
+            default:
+                throw std::runtime_error("Corrupted base");
+            }
+            if (size > message.size() - pos) {
+                throw std::runtime_error("Corrupted base");
+            }
+            pos += size;
+            value = (tag & 7) == 2 ? message.substr(pos - size, size) : message.substr(value_begin, pos - value_begin);
+            return static_cast<uint32_t>(tag >> 3);
+        }
+
+        // Режет сообщение по границам полей на куски около PARSE_PIECE_SIZE.
+        // Каждый кусок - корректное сообщение того же типа, а слияние кусков
+        // по порядку даёт исходное сообщение
+        void SplitIntoPieces(std::string_view message, std::vector<std::string_view>& pieces) {
+            size_t piece_begin = 0;
+            size_t pos = 0;
+            std::string_view value;
+            while (pos < message.size()) {
+                SkipField(message, pos, value);
+                if (pos - piece_begin >= PARSE_PIECE_SIZE) {
+                    pieces.push_back(message.substr(piece_begin, pos - piece_begin));
+                    piece_begin = pos;
+                }
+            }
+            if (piece_begin < message.size()) {
+                pieces.push_back(message.substr(piece_begin));
+            }
+        }
+
+        // Перекладывает элементы повторяемого поля, не копируя их.
+        // Оба поля должны жить на одной арене
+        template <typename Item>
+        void MoveRepeated(google::protobuf::RepeatedPtrField<Item>& from, google::protobuf::RepeatedPtrField<Item>& to) {
+            std::vector<Item*> items(from.size());
+            from.UnsafeArenaExtractSubrange(0, from.size(), items.data());
+            to.Reserve(to.size() + static_cast<int>(items.size()));
+            for (Item* item : items) {
+                to.UnsafeArenaAddAllocated(item);
+            }
+        }
+
+        template <typename Message>
+        Message* CreateMessage(google::protobuf::Arena& arena) {
+            return google::protobuf::Arena::CreateMessage<Message>(&arena);
+        }
+
+        // Файл базы. Несжатый читается по диапазонам, у сжатого распаковываются
+        // только блоки, пересекающие нужные диапазоны
+        class BaseFile {
+        public:
+            using Range = base_codec::CompressedReader::Range;
+
+            explicit BaseFile(const std::filesystem::path& path)
+                : in_(path, std::ios::binary)
+                , size_(std::filesystem::file_size(path)) {
+                if (base_codec::IsCompressed(ReadFile({ 0, std::min<uint64_t>(size_, 8) }))) {
+                    compressed_.emplace(ReadFile({ 0, size_ }));
+                }
+            }
+
+            uint64_t GetSize() const {
+                return compressed_ ? compressed_->GetRawSize() : size_;
+            }
+
+            std::string Read(const std::vector<Range>& ranges) {
+                if (compressed_) {
+                    return compressed_->ReadRanges(ranges);
+                }
+                std::string data;
+                for (const Range& range : ranges) {
+                    data += ReadFile(range);
+                }
+                return data;
+            }
+
+            // Оглавление, на которое указывает последнее поле файла;
+            // nullopt - база записана без оглавления
+            std::optional<proto_catalogue::BaseContents> ReadContents() {
+                if (GetSize() < TRAILER_SIZE) {
+                    return std::nullopt;
+                }
+                const uint64_t trailer_offset = GetSize() - TRAILER_SIZE;
+                const std::string trailer = Read({ { trailer_offset, TRAILER_SIZE } });
+                if (static_cast<unsigned char>(trailer[0]) != CONTENTS_OFFSET_TAG) {
+                    return std::nullopt;
+                }
+                uint64_t offset = 0;
+                for (size_t i = TRAILER_SIZE - 1; i > 0; --i) {
+                    offset = offset << 8 | static_cast<unsigned char>(trailer[i]);
+                }
+                if (offset >= trailer_offset) {
+                    return std::nullopt;
+                }
+                const std::string field = Read({ { offset, trailer_offset - offset } });
+                proto_catalogue::BaseContents contents;
+                try {
+                    size_t pos = 0;
+                    std::string_view value;
+                    if (SkipField(field, pos, value) != CONTENTS_FIELD || pos != field.size()
+                        || !contents.ParseFromArray(value.data(), static_cast<int>(value.size()))) {
+                        return std::nullopt;
+                    }
+                }
+                catch (const std::runtime_error&) {
+                    return std::nullopt;
+                }
+                return contents;
+            }
+
+        private:
+            std::string ReadFile(Range range) {
+                std::string data(range.second, '\0');
+                in_.seekg(static_cast<std::streamoff>(range.first));
+                in_.read(data.data(), static_cast<std::streamsize>(data.size()));
+                if (!in_) {
+                    throw std::runtime_error("Failed to read the base");
+                }
+                return data;
+            }
+
+            std::ifstream in_;
+            uint64_t size_;
+            std::optional<base_codec::CompressedReader> compressed_;
+        };
+
+        uint64_t FingerprintFile(const std::filesystem::path& path) {
+            std::ifstream in(path, std::ios::binary);
+            std::string data(std::filesystem::file_size(path), '\0');
+            in.read(data.data(), static_cast<std::streamsize>(data.size()));
+            return base_codec::Fingerprint(data);
+        }
+
+        std::vector<std::string_view> GetStopNames(const domain::Bus& bus) {
+            std::vector<std::string_view> names;
+            names.reserve(bus.stops.size());
+            for (const auto* stop : bus.stops) {
+                names.push_back(stop->name);
+            }
+            return names;
+        }
+
+        std::map<std::pair<std::string, std::string>, uint64_t> GetNamedDistances(transport_db::TransportCatalogue& catalogue) {
+            std::map<std::pair<std::string, std::string>, uint64_t> distances;
+            for (const auto& [from_to, distance] : catalogue.GetStopsFromTo()) {
+                distances.emplace(std::pair{ from_to.first->name, from_to.second->name }, distance);
+            }
+            return distances;
+        }
+    }
+
+    // Пишет поля верхнего уровня TransportCatalogue по одному куску. Повторно
+    // встреченное поле-сообщение протобуф при разборе сливает с прежним,
+    // а повторяемые поля в нём дописывает, поэтому база из кусков читается
+    // как одно сообщение и прежним кодом. Куски отмечаются в оглавлении,
+    // которое пишется в конце файла
+    class Serialization::BaseWriter {
+    public:
+        BaseWriter(const std::filesystem::path& path, bool compress)
+            : path_(path)
+            , out_(path, std::ios::binary) {
+            if (compress) {
+                compressed_.emplace(out_);
+            }
+        }
+
+        void WriteField(int field_number, const google::protobuf::MessageLite& message, uint32_t section) {
+            auto& entry = *contents_.add_sections();
+            entry.set_kind(section);
+            entry.set_offset(offset_);
+            Write(EncodeField(field_number, message));
+            entry.set_size(offset_ - entry.offset());
+        }
+
+        // Отпечаток всего записанного до сих пор, без сжатия
+        uint64_t GetFingerprint() const {
+            return fingerprint_;
+        }
+
+        // Дописывает оглавление и ссылку на него
+        void Finish() {
+            const uint64_t contents_offset = offset_;
+            Write(EncodeField(CONTENTS_FIELD, contents_));
+            std::string trailer(1, static_cast<char>(CONTENTS_OFFSET_TAG));
+            for (size_t i = 1; i < TRAILER_SIZE; ++i) {
+                trailer.push_back(static_cast<char>(contents_offset >> (8 * (i - 1))));
+            }
+            Write(trailer);
+            if (compressed_) {
+                compressed_->Finish();
+            }
+            out_.close();
+            if (!out_) {
+                throw std::runtime_error("Failed to write the base to " + path_.string());
+            }
+        }
+
+    private:
+        static std::string EncodeField(int field_number, const google::protobuf::MessageLite& message) {
+            std::string chunk;
+            base_codec::WriteVarint(chunk, static_cast<uint64_t>(field_number) << 3 | 2);
+            base_codec::WriteVarint(chunk, message.ByteSizeLong());
+            message.AppendToString(&chunk);
+            return chunk;
+        }
+
+        void Write(std::string_view data) {
+            fingerprint_ = base_codec::Fingerprint(data, fingerprint_);
+            if (compressed_) {
+                compressed_->Write(data);
+            }
+            else {
+                out_.write(data.data(), static_cast<std::streamsize>(data.size()));
+            }
+            offset_ += data.size();
+        }
+
+        std::filesystem::path path_;
+        std::ofstream out_;
+        std::optional<base_codec::CompressedWriter> compressed_;
+        uint64_t offset_ = 0;
+        uint64_t fingerprint_ = base_codec::FINGERPRINT_BASIS;
+        proto_catalogue::BaseContents contents_;
+    };
+
     Serialization::Serialization(transport_db::TransportCatalogue& transport_catalogue)
-        : transport_catalogue_(transport_catalogue) {}
+        : transport_catalogue_(transport_catalogue)
+        , arena_(std::make_unique<google::protobuf::Arena>())
+        , base_(CreateMessage<proto_catalogue::TransportCatalogue>(*arena_)) {}
+
+    Serialization::~Serialization() = default;
 
     void Serialization::SetSetting(const std::filesystem::path& path_to_base) {
         path_ = path_to_base;
     }
 
-    void Serialization::Serialize(transport_db::TransportCatalogue& cat)
+    void Serialization::SetCompression(bool compress) {
+        compress_ = compress;
+    }
+
+    void Serialization::SetStopOrder(stop_order::StopOrder order, stop_order::Permutation input_positions) {
+        stop_order_ = order;
+        stop_input_positions_ = std::move(input_positions);
+    }
+
+    void Serialization::SetDelta(const std::filesystem::path& delta_path) {
+        delta_path_ = delta_path;
+    }
+
+    BaseFormat Serialization::DetectFormat() const {
+        return catalogue_image::IsImageFile(path_) ? BaseFormat::FLAT : BaseFormat::PROTOBUF;
+    }
+
+    void Serialization::Serialize(const std::function<void()>& write_answers)
     {
-        std::ofstream out_file(path_, std::ios::binary);
+        BeginSerialize();
+        SerializeCatalogue();
+        if (write_answers) {
+            write_answers();
+        }
+        FinishSerialize();
+    }
+
+    // Пишем во временный файл и переименовываем: процессы, читающие базу,
+    // не увидят её недописанной
+    void Serialization::BeginSerialize() {
+        pending_answers_.Clear();
+        writer_ = std::make_unique<BaseWriter>(GetTempPath(), compress_);
+        proto_catalogue::TransportCatalogueBase header;
+        header.set_schema_version(SCHEMA_VERSION);
+        header.set_stop_order(static_cast<uint32_t>(stop_order_));
+        header.mutable_stop_input_positions()->Add(stop_input_positions_.begin(), stop_input_positions_.end());
+        writer_->WriteField(TRANSPORT_BASE_FIELD, header, ALWAYS_LOADED);
+    }
+
+    void Serialization::SerializeCatalogue() {
         SerializeStops();
         SerializeDistanceFromTo();
         SerializeBuses();
-        base_.SerializeToOstream(&out_file);
     }
 
-    void Serialization::DeserializeCatalogue(transport_db::TransportCatalogue& cat) {
-        std::ifstream in_file(path_, std::ios::binary);
-        base_.ParseFromIstream(&in_file);
+    void Serialization::FinishSerialize() {
+        FlushAnswers();
+        // Карта и настройки маршрутизатора накоплены в base_ и пишутся последними
+        if (base_->has_map_ren()) {
+            writer_->WriteField(MAP_REN_FIELD, base_->map_ren(), SECTION_MAP);
+        }
+        if (base_->has_router_set()) {
+            writer_->WriteField(ROUTER_SET_FIELD, base_->router_set(), ALWAYS_LOADED);
+        }
+        // Отпечаток дописывается в заголовок последним куском: при разборе он
+        // сливается с заголовком, и дельта сверяет его без перечитывания файла
+        proto_catalogue::TransportCatalogueBase fingerprint;
+        fingerprint.set_base_fingerprint(writer_->GetFingerprint());
+        writer_->WriteField(TRANSPORT_BASE_FIELD, fingerprint, ALWAYS_LOADED);
+        // Запись закрывается и при ошибке: ответы снова копятся в base_
+        std::unique_ptr<BaseWriter> writer = std::move(writer_);
+        writer->Finish();
+        writer.reset();
+        std::filesystem::rename(GetTempPath(), path_);
+    }
+
+    std::filesystem::path Serialization::GetTempPath() const {
+        return path_.string() + ".tmp";
+    }
+
+    // База, записанная до появления отпечатка в заголовке, хешируется целиком
+    uint64_t Serialization::GetBaseFingerprint() const {
+        const uint64_t fingerprint = base_->transport_base().base_fingerprint();
+        return fingerprint != 0 ? fingerprint : FingerprintFile(path_);
+    }
+
+    void Serialization::DeserializeCatalogue(const SectionChooser& choose_sections) {
+        BaseFile file(path_);
+        std::vector<BaseFile::Range> ranges;
+        if (choose_sections && delta_path_.empty()) {
+            if (const auto contents = file.ReadContents()) {
+                uint32_t available = 0;
+                for (const auto& section : contents->sections()) {
+                    available |= section.kind();
+                }
+                const uint32_t chosen = choose_sections(available);
+                for (const auto& section : contents->sections()) {
+                    if (section.kind() != ALWAYS_LOADED && (section.kind() & chosen) == 0) {
+                        continue;
+                    }
+                    // Соседние куски читаются одним диапазоном
+                    if (!ranges.empty() && ranges.back().first + ranges.back().second == section.offset()) {
+                        ranges.back().second += section.size();
+                    }
+                    else {
+                        ranges.emplace_back(section.offset(), section.size());
+                    }
+                }
+            }
+        }
+        if (ranges.empty()) {
+            ranges.emplace_back(0, file.GetSize());
+        }
+        ParseBase(file.Read(ranges));
+        if (!delta_path_.empty()) {
+            ApplyDelta();
+        }
         DeserializeStops();
-        DeserializeDistanceFromTo();
+        // Расстояния и автобусы заполняют разные таблицы справочника
+        // и после загрузки остановок грузятся одновременно
+        auto distances = std::async(std::launch::async, [this] {
+            DeserializeDistanceFromTo();
+        });
         DeserializeBuses();
+        distances.get();
     }
 
-    proto_catalogue::Stop Serialization::SaveStop(const domain::Stop& stop) const {
-        proto_catalogue::Stop proto_stop;
-        proto_stop.set_id(stop.edge_id);
+    void Serialization::ParseBase(std::string_view data) {
+        arena_ = std::make_unique<google::protobuf::Arena>();
+        base_ = CreateMessage<proto_catalogue::TransportCatalogue>(*arena_);
+        std::vector<std::string_view> base_pieces;
+        std::vector<std::string_view> answer_pieces;
+        size_t pos = 0;
+        std::string_view value;
+        while (pos < data.size()) {
+            const size_t field_begin = pos;
+            const uint32_t field = SkipField(data, pos, value);
+            if (field == TRANSPORT_BASE_FIELD) {
+                SplitIntoPieces(value, base_pieces);
+            }
+            else if (field == ANSWERS_FIELD) {
+                SplitIntoPieces(value, answer_pieces);
+            }
+            // Карта и настройки маршрутизатора разбираются сразу в base_
+            else {
+                google::protobuf::io::CodedInputStream input(reinterpret_cast<const uint8_t*>(data.data() + field_begin), static_cast<int>(pos - field_begin));
+                if (!base_->MergeFromCodedStream(&input)) {
+                    throw std::runtime_error("Corrupted base " + path_.string());
+                }
+            }
+        }
+
+        // Куски разбираются на арене base_ (она потокобезопасна),
+        // поэтому их элементы переходят в base_ без копирования
+        std::vector<proto_catalogue::TransportCatalogueBase*> bases(base_pieces.size());
+        std::vector<proto_catalogue::AnswerFragments*> answers(answer_pieces.size());
+        thread_pool::ParallelFor(bases.size() + answers.size(), [&](size_t i) {
+            bool parsed = false;
+            if (i < bases.size()) {
+                bases[i] = CreateMessage<proto_catalogue::TransportCatalogueBase>(*arena_);
+                parsed = bases[i]->ParseFromArray(base_pieces[i].data(), static_cast<int>(base_pieces[i].size()));
+            }
+            else {
+                const size_t j = i - bases.size();
+                answers[j] = CreateMessage<proto_catalogue::AnswerFragments>(*arena_);
+                parsed = answers[j]->ParseFromArray(answer_pieces[j].data(), static_cast<int>(answer_pieces[j].size()));
+            }
+            if (!parsed) {
+                throw std::runtime_error("Corrupted base " + path_.string());
+            }
+        });
+
+        auto& transport_base = *base_->mutable_transport_base();
+        for (auto* piece : bases) {
+            MoveRepeated(*piece->mutable_stops(), *transport_base.mutable_stops());
+            MoveRepeated(*piece->mutable_buses(), *transport_base.mutable_buses());
+            MoveRepeated(*piece->mutable_distance_from_to(), *transport_base.mutable_distance_from_to());
+            transport_base.MergeFrom(*piece);
+        }
+        for (auto* piece : answers) {
+            MoveRepeated(*piece->mutable_stops(), *base_->mutable_answers()->mutable_stops());
+            MoveRepeated(*piece->mutable_buses(), *base_->mutable_answers()->mutable_buses());
+            base_->mutable_answers()->MergeFrom(*piece);
+        }
+    }
+
+    void Serialization::SaveStop(const domain::Stop& stop, proto_catalogue::Stop& proto_stop) const {
+        // Номер остановки - её позиция в списке, отдельно он не пишется;
+        // координаты лежат столбцом в stop_columns
         proto_stop.set_stop_name(stop.name);
-        proto_stop.mutable_coordinates()->set_lat(stop.coords.lat);
-        proto_stop.mutable_coordinates()->set_lon(stop.coords.lng);
-        return proto_stop;
     }
     
-    proto_catalogue::DistanceFromTo Serialization::SaveDistanceFromTo(domain::Stop* from, domain::Stop* to, size_t distance) const {
-        proto_catalogue::DistanceFromTo proto_dist;
-        proto_dist.set_from(from->name);
-        proto_dist.set_to(to->name);
-        proto_dist.set_distance(distance);
-        return proto_dist;
-    }
-
-    proto_catalogue::Bus Serialization::SaveBus(const domain::Bus& bus) const {
-        proto_catalogue::Bus proto_bus;
+    void Serialization::SaveBus(const domain::Bus& bus, proto_catalogue::Bus& proto_bus) const {
         proto_bus.set_is_roundtrip(bus.is_roundtrip);
         proto_bus.set_bus_name(bus.bus_number);
+        proto_bus.mutable_stop_ids()->Reserve(static_cast<int>(bus.stops.size()));
         for (const auto& stop : bus.stops) {
-            proto_bus.add_names_of_stops(stop->name);
+            proto_bus.add_stop_ids(static_cast<uint32_t>(stop->edge_id));
         }
-        return proto_bus;
     }
 
+    // Кусок собирается на арене. Clear оставляет элементы и строки куска
+    // себе, и следующий кусок заполняет их заново без новых выделений
     void Serialization::SerializeStops() {
-        for (const auto& stop : transport_catalogue_.GetAllStops()) {
-            *base_.mutable_transport_base()->add_stops() = std::move(SaveStop(stop));
+        google::protobuf::Arena arena;
+        auto& chunk = *CreateMessage<proto_catalogue::TransportCatalogueBase>(arena);
+        const auto& stops = transport_catalogue_.GetAllStops();
+        chunk.mutable_stops()->Reserve(static_cast<int>(std::min<size_t>(stops.size(), CHUNK_SIZE)));
+        std::vector<geo::Coordinates> coordinates;
+        coordinates.reserve(stops.size());
+        for (const auto& stop : stops) {
+            SaveStop(stop, *chunk.add_stops());
+            coordinates.push_back(stop.coords);
+            if (chunk.stops_size() == CHUNK_SIZE) {
+                writer_->WriteField(TRANSPORT_BASE_FIELD, chunk, ALWAYS_LOADED);
+                chunk.Clear();
+            }
         }
+        const base_codec::EncodedCoordinates encoded = base_codec::EncodeCoordinates(coordinates);
+        auto& columns = *chunk.mutable_stop_columns();
+        columns.set_fixed_point(encoded.scale_digits.has_value());
+        columns.set_scale_digits(encoded.scale_digits.value_or(0));
+        columns.set_deltas(encoded.deltas);
+        columns.mutable_raw()->Add(encoded.raw.begin(), encoded.raw.end());
+        writer_->WriteField(TRANSPORT_BASE_FIELD, chunk, ALWAYS_LOADED);
     }
 
     void Serialization::SerializeDistanceFromTo() {
-        for (const auto& [from_to, distance] : transport_catalogue_.GetStopsFromTo()) {
-            *base_.mutable_transport_base()->add_distance_from_to() = std::move(SaveDistanceFromTo(from_to.first, from_to.second, distance));
+        const auto& stops_from_to = transport_catalogue_.GetStopsFromTo();
+        std::vector<base_codec::Distance> distances;
+        distances.reserve(stops_from_to.size());
+        for (const auto& [from_to, distance] : stops_from_to) {
+            distances.emplace_back(static_cast<uint32_t>(from_to.first->edge_id), static_cast<uint32_t>(from_to.second->edge_id), distance);
         }
+        // Упорядочение нужно для разностной кодировки и даёт одинаковую базу
+        // для одинакового справочника
+        std::sort(distances.begin(), distances.end());
+        proto_catalogue::TransportCatalogueBase chunk;
+        chunk.set_distance_columns(base_codec::EncodeDistances(distances));
+        writer_->WriteField(TRANSPORT_BASE_FIELD, chunk, SECTION_DISTANCES);
     }
 
     void Serialization::SerializeBuses() {
-        for (const auto& bus : transport_catalogue_.GetAllBuses()) {
-            *base_.mutable_transport_base()->add_buses() = std::move(SaveBus(bus));
+        google::protobuf::Arena arena;
+        auto& chunk = *CreateMessage<proto_catalogue::TransportCatalogueBase>(arena);
+        const auto& buses = transport_catalogue_.GetAllBuses();
+        chunk.mutable_buses()->Reserve(static_cast<int>(std::min<size_t>(buses.size(), CHUNK_SIZE)));
+        for (const auto& bus : buses) {
+            SaveBus(bus, *chunk.add_buses());
+            if (chunk.buses_size() == CHUNK_SIZE) {
+                writer_->WriteField(TRANSPORT_BASE_FIELD, chunk, SECTION_BUSES);
+                chunk.Clear();
+            }
+        }
+        if (chunk.buses_size() > 0) {
+            writer_->WriteField(TRANSPORT_BASE_FIELD, chunk, SECTION_BUSES);
         }
     }
 
     void Serialization::SerializeRouterSetVelosity(std::map <std::string, double> router_settings_velosity)
     {
-        base_.mutable_router_set()->set_bus_velocity(router_settings_velosity.at("bus_velocity"));
+        base_->mutable_router_set()->set_bus_velocity(router_settings_velosity.at("bus_velocity"));
     }
 
     void Serialization::SerializeRouterSetTime(std::map <std::string, int> router_settings_time)
     {
-        base_.mutable_router_set()->set_bus_wait_time(router_settings_time.at("bus_wait_time"));
+        base_->mutable_router_set()->set_bus_wait_time(router_settings_time.at("bus_wait_time"));
     }
 
     void Serialization::SerializeMapRender(std::string map) {
-        base_.mutable_map_ren()->set_str_of_result_map_render(map);
+        base_->mutable_map_ren()->set_str_of_result_map_render(map);
     }
 
-    void Serialization::LoadStop(const proto_catalogue::Stop& stop) {
-        geo::Coordinates coordinates;
-        coordinates.lat = stop.coordinates().lat();
-        coordinates.lng = stop.coordinates().lon();
-        transport_catalogue_.AddStop(coordinates, stop.stop_name());
+    void Serialization::LoadStop(proto_catalogue::Stop& stop, geo::Coordinates coordinates) {
+        stops_by_id_.push_back(transport_catalogue_.AddStop(coordinates, std::move(*stop.mutable_stop_name())));
     }
 
     void Serialization::LoadDistanceFromTo(const proto_catalogue::DistanceFromTo& distance_from_to) {
@@ -109,43 +567,549 @@ namespace serialize {
         transport_catalogue_.SetDistance(from, to, distance_from_to.distance());
     }
 
-    void Serialization::LoadBus(const proto_catalogue::Bus& bus) {
+    domain::Bus Serialization::LoadBus(proto_catalogue::Bus& bus) {
         domain::Bus tmp;
         tmp.is_roundtrip = bus.is_roundtrip();
-        tmp.bus_number = bus.bus_name();
-        for (int i = 0; i < bus.names_of_stops_size(); ++i) {
-            tmp.stops.push_back(transport_catalogue_.GetStopByName(bus.names_of_stops(i)));
+        tmp.bus_number = std::move(*bus.mutable_bus_name());
+        if (base_->transport_base().schema_version() >= 2) {
+            tmp.stops.reserve(bus.stop_ids_size());
+            for (const uint32_t stop_id : bus.stop_ids()) {
+                tmp.stops.push_back(stops_by_id_.at(stop_id));
+            }
+        }
+        else {
+            for (int i = 0; i < bus.names_of_stops_size(); ++i) {
+                tmp.stops.push_back(transport_catalogue_.GetStopByName(bus.names_of_stops(i)));
+            }
         }
-        transport_catalogue_.AddRoute(tmp);
+        return tmp;
     }
 
     void Serialization::DeserializeStops() {
-        for (int i = 0; i < base_.transport_base().stops_size(); ++i) {
-            LoadStop(base_.transport_base().stops(i));
+        stops_by_id_.clear();
+        auto& transport_base = *base_->mutable_transport_base();
+        stops_by_id_.reserve(transport_base.stops_size());
+        transport_catalogue_.ReserveStops(transport_base.stops_size());
+        transport_catalogue_.ReserveBuses(transport_base.buses_size());
+        const std::vector<geo::Coordinates> coordinates = DecodeStopCoordinates();
+        for (int i = 0; i < transport_base.stops_size(); ++i) {
+            LoadStop(*transport_base.mutable_stops(i), coordinates[i]);
+        }
+    }
+
+    std::vector<geo::Coordinates> Serialization::DecodeStopCoordinates() const {
+        const auto& transport_base = base_->transport_base();
+        if (transport_base.schema_version() >= 3) {
+            const auto& columns = transport_base.stop_columns();
+            base_codec::EncodedCoordinates encoded;
+            if (columns.fixed_point()) {
+                encoded.scale_digits = columns.scale_digits();
+            }
+            encoded.deltas = columns.deltas();
+            encoded.raw.assign(columns.raw().begin(), columns.raw().end());
+            return base_codec::DecodeCoordinates(encoded, transport_base.stops_size());
+        }
+        std::vector<geo::Coordinates> coordinates;
+        coordinates.reserve(transport_base.stops_size());
+        for (const auto& stop : transport_base.stops()) {
+            coordinates.push_back({ stop.coordinates().lat(), stop.coordinates().lon() });
+        }
+        return coordinates;
+    }
+
+    std::map<std::pair<std::string, std::string>, uint64_t> Serialization::DecodeNamedDistances() const {
+        const auto& transport_base = base_->transport_base();
+        std::map<std::pair<std::string, std::string>, uint64_t> distances;
+        auto add = [&](uint64_t from, uint64_t to, uint64_t distance) {
+            if (from >= static_cast<uint64_t>(transport_base.stops_size()) || to >= static_cast<uint64_t>(transport_base.stops_size())) {
+                throw std::runtime_error("Corrupted distances in the base");
+            }
+            distances.emplace(std::pair{ transport_base.stops(static_cast<int>(from)).stop_name(), transport_base.stops(static_cast<int>(to)).stop_name() }, distance);
+        };
+        if (transport_base.schema_version() >= 3) {
+            if (!transport_base.distance_columns().empty()) {
+                for (const auto& [from, to, distance] : base_codec::DecodeDistances(transport_base.distance_columns())) {
+                    add(from, to, distance);
+                }
+            }
         }
+        else if (transport_base.schema_version() >= 2) {
+            const auto& table = transport_base.distance_table();
+            if (table.to_ids_size() != table.from_ids_size() || table.distances_size() != table.from_ids_size()) {
+                throw std::runtime_error("Corrupted distance table in the base");
+            }
+            for (int i = 0; i < table.from_ids_size(); ++i) {
+                add(table.from_ids(i), table.to_ids(i), table.distances(i));
+            }
+        }
+        else {
+            for (const auto& distance : transport_base.distance_from_to()) {
+                distances.emplace(std::pair{ distance.from(), distance.to() }, distance.distance());
+            }
+        }
+        return distances;
+    }
+
+    void Serialization::SerializeDelta(const std::filesystem::path& delta_path, const DeltaAnswersWriter& write_answers) {
+        transport_db::TransportCatalogue old_catalogue;
+        Serialization old_base(old_catalogue);
+        old_base.SetSetting(path_);
+        old_base.DeserializeCatalogue();
+
+        proto_catalogue::BaseDelta delta;
+        delta.set_base_fingerprint(old_base.GetBaseFingerprint());
+
+        // Остановки, у которых мог измениться список автобусов, и остановки,
+        // от которых зависят длины проходящих через них маршрутов
+        std::set<std::string> answered_stops;
+        std::set<std::string> route_stops;
+        for (const auto& stop : transport_catalogue_.GetAllStops()) {
+            const domain::Stop* old_stop = old_catalogue.GetStopByName(stop.name);
+            if (old_stop && old_stop->coords == stop.coords) {
+                continue;
+            }
+            auto& proto_stop = *delta.add_stops();
+            proto_stop.set_stop_name(stop.name);
+            proto_stop.mutable_coordinates()->set_lat(stop.coords.lat);
+            proto_stop.mutable_coordinates()->set_lon(stop.coords.lng);
+            answered_stops.insert(stop.name);
+            route_stops.insert(stop.name);
+        }
+        for (const auto& stop : old_catalogue.GetAllStops()) {
+            if (!transport_catalogue_.GetStopByName(stop.name)) {
+                delta.add_removed_stops(stop.name);
+            }
+        }
+
+        const auto old_distances = GetNamedDistances(old_catalogue);
+        const auto new_distances = GetNamedDistances(transport_catalogue_);
+        for (const auto& [from_to, distance] : new_distances) {
+            const auto it = old_distances.find(from_to);
+            if (it != old_distances.end() && it->second == distance) {
+                continue;
+            }
+            auto& proto_distance = *delta.add_distances();
+            proto_distance.set_from(from_to.first);
+            proto_distance.set_to(from_to.second);
+            proto_distance.set_distance(distance);
+            route_stops.insert(from_to.first);
+            route_stops.insert(from_to.second);
+        }
+        for (const auto& [from_to, distance] : old_distances) {
+            if (new_distances.count(from_to) == 0) {
+                auto& proto_distance = *delta.add_removed_distances();
+                proto_distance.set_from(from_to.first);
+                proto_distance.set_to(from_to.second);
+                route_stops.insert(from_to.first);
+                route_stops.insert(from_to.second);
+            }
+        }
+
+        std::set<std::string> answered_buses;
+        for (const auto& bus : transport_catalogue_.GetAllBuses()) {
+            const domain::Bus* old_bus = old_catalogue.GetRouteByName(bus.bus_number);
+            const std::vector<std::string_view> stop_names = GetStopNames(bus);
+            if (old_bus && old_bus->is_roundtrip == bus.is_roundtrip && GetStopNames(*old_bus) == stop_names) {
+                if (std::any_of(stop_names.begin(), stop_names.end(), [&route_stops](std::string_view name) {
+                    return route_stops.count(std::string(name)) > 0;
+                })) {
+                    answered_buses.insert(bus.bus_number);
+                }
+                continue;
+            }
+            auto& proto_bus = *delta.add_buses();
+            proto_bus.set_bus_name(bus.bus_number);
+            proto_bus.set_is_roundtrip(bus.is_roundtrip);
+            for (const std::string_view name : stop_names) {
+                proto_bus.add_names_of_stops(name.data(), name.size());
+                answered_stops.emplace(name);
+            }
+            if (old_bus) {
+                for (const std::string_view name : GetStopNames(*old_bus)) {
+                    answered_stops.emplace(name);
+                }
+            }
+            answered_buses.insert(bus.bus_number);
+        }
+        for (const auto& bus : old_catalogue.GetAllBuses()) {
+            if (!transport_catalogue_.GetRouteByName(bus.bus_number)) {
+                delta.add_removed_buses(bus.bus_number);
+                for (const std::string_view name : GetStopNames(bus)) {
+                    answered_stops.emplace(name);
+                }
+            }
+        }
+
+        const bool map_changed = old_base.DeserializeMapRenderer() != base_->map_ren().str_of_result_map_render();
+        if (map_changed) {
+            *delta.mutable_map_ren() = base_->map_ren();
+        }
+        if (base_->has_router_set()) {
+            *delta.mutable_router_set() = base_->router_set();
+        }
+
+        std::vector<std::string_view> stops;
+        for (const auto& name : answered_stops) {
+            // У удалённых остановок ответов нет
+            if (transport_catalogue_.GetStopByName(name)) {
+                stops.push_back(name);
+                delta.add_answered_stops(name);
+            }
+        }
+        const std::vector<std::string_view> buses(answered_buses.begin(), answered_buses.end());
+        for (const auto& name : answered_buses) {
+            delta.add_answered_buses(name);
+        }
+        base_->clear_answers();
+        write_answers(stops, buses);
+        delta.mutable_answers()->Swap(base_->mutable_answers());
+
+        const std::filesystem::path temp_path = delta_path.string() + ".tmp";
+        {
+            std::ofstream out_file(temp_path, std::ios::binary);
+            if (!delta.SerializeToOstream(&out_file)) {
+                throw std::runtime_error("Failed to write the delta to " + temp_path.string());
+            }
+        }
+        std::filesystem::rename(temp_path, delta_path);
+    }
+
+    void Serialization::ApplyDelta() {
+        proto_catalogue::BaseDelta delta;
+        {
+            std::ifstream in_file(delta_path_, std::ios::binary);
+            if (!in_file || !delta.ParseFromIstream(&in_file)) {
+                throw std::runtime_error("Failed to read the base delta " + delta_path_.string());
+            }
+        }
+        if (delta.base_fingerprint() != GetBaseFingerprint()) {
+            throw std::runtime_error("The delta " + delta_path_.string() + " was made for another base");
+        }
+
+        const auto& transport_base = base_->transport_base();
+        const std::vector<geo::Coordinates> coordinates = DecodeStopCoordinates();
+        auto distances = DecodeNamedDistances();
+        // Новые части базы собираются на её арене: Swap с base_ тогда обменивает указатели
+        auto& result = *CreateMessage<proto_catalogue::TransportCatalogueBase>(*arena_);
+        result.set_schema_version(SCHEMA_VERSION);
+
+        // Остановки: удалённые выбывают, изменённые и новые берутся из дельты.
+        // Для ответов запоминается прежний номер каждой остановки (-1 - новая)
+        const std::unordered_set<std::string> removed_stops(delta.removed_stops().begin(), delta.removed_stops().end());
+        std::unordered_map<std::string, int> stop_positions;
+        std::vector<int> old_stop_ids;
+        std::vector<geo::Coordinates> result_coordinates;
+        for (int i = 0; i < transport_base.stops_size(); ++i) {
+            const std::string& name = transport_base.stops(i).stop_name();
+            if (removed_stops.count(name) > 0) {
+                continue;
+            }
+            result.add_stops()->set_stop_name(name);
+            result_coordinates.push_back(coordinates[i]);
+            stop_positions.emplace(name, result.stops_size() - 1);
+            old_stop_ids.push_back(i);
+        }
+        for (const auto& stop : delta.stops()) {
+            const geo::Coordinates stop_coordinates{ stop.coordinates().lat(), stop.coordinates().lon() };
+            if (const auto it = stop_positions.find(stop.stop_name()); it != stop_positions.end()) {
+                result_coordinates[it->second] = stop_coordinates;
+            }
+            else {
+                result.add_stops()->set_stop_name(stop.stop_name());
+                result_coordinates.push_back(stop_coordinates);
+                stop_positions.emplace(stop.stop_name(), result.stops_size() - 1);
+                old_stop_ids.push_back(-1);
+            }
+        }
+        const base_codec::EncodedCoordinates encoded = base_codec::EncodeCoordinates(result_coordinates);
+        auto& columns = *result.mutable_stop_columns();
+        columns.set_fixed_point(encoded.scale_digits.has_value());
+        columns.set_scale_digits(encoded.scale_digits.value_or(0));
+        columns.set_deltas(encoded.deltas);
+        columns.mutable_raw()->Add(encoded.raw.begin(), encoded.raw.end());
+
+        auto get_stop_id = [&](const std::string& name) {
+            const auto it = stop_positions.find(name);
+            if (it == stop_positions.end()) {
+                throw std::runtime_error("The delta " + delta_path_.string() + " refers to an unknown stop " + name);
+            }
+            return static_cast<uint32_t>(it->second);
+        };
+
+        for (auto it = distances.begin(); it != distances.end();) {
+            if (removed_stops.count(it->first.first) > 0 || removed_stops.count(it->first.second) > 0) {
+                it = distances.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        for (const auto& distance : delta.removed_distances()) {
+            distances.erase({ distance.from(), distance.to() });
+        }
+        for (const auto& distance : delta.distances()) {
+            distances[{ distance.from(), distance.to() }] = distance.distance();
+        }
+        std::vector<base_codec::Distance> distance_columns;
+        distance_columns.reserve(distances.size());
+        for (const auto& [from_to, meters] : distances) {
+            distance_columns.emplace_back(get_stop_id(from_to.first), get_stop_id(from_to.second), meters);
+        }
+        std::sort(distance_columns.begin(), distance_columns.end());
+        result.set_distance_columns(base_codec::EncodeDistances(distance_columns));
+
+        const std::unordered_set<std::string> removed_buses(delta.removed_buses().begin(), delta.removed_buses().end());
+        std::unordered_map<std::string, int> bus_positions;
+        std::vector<int> old_bus_ids;
+        for (int i = 0; i < transport_base.buses_size(); ++i) {
+            const auto& old_bus = transport_base.buses(i);
+            if (removed_buses.count(old_bus.bus_name()) > 0) {
+                continue;
+            }
+            auto& bus = *result.add_buses();
+            bus.set_bus_name(old_bus.bus_name());
+            bus.set_is_roundtrip(old_bus.is_roundtrip());
+            if (transport_base.schema_version() >= 2) {
+                for (const uint32_t stop_id : old_bus.stop_ids()) {
+                    if (stop_id >= static_cast<uint32_t>(transport_base.stops_size())) {
+                        throw std::runtime_error("Corrupted bus in the base");
+                    }
+                    bus.add_stop_ids(get_stop_id(transport_base.stops(static_cast<int>(stop_id)).stop_name()));
+                }
+            }
+            else {
+                for (const auto& name : old_bus.names_of_stops()) {
+                    bus.add_stop_ids(get_stop_id(name));
+                }
+            }
+            bus_positions.emplace(bus.bus_name(), result.buses_size() - 1);
+            old_bus_ids.push_back(i);
+        }
+        for (const auto& delta_bus : delta.buses()) {
+            proto_catalogue::Bus* bus = nullptr;
+            if (const auto it = bus_positions.find(delta_bus.bus_name()); it != bus_positions.end()) {
+                bus = result.mutable_buses(it->second);
+                bus->clear_stop_ids();
+            }
+            else {
+                bus = result.add_buses();
+                bus->set_bus_name(delta_bus.bus_name());
+                bus_positions.emplace(delta_bus.bus_name(), result.buses_size() - 1);
+                old_bus_ids.push_back(-1);
+            }
+            bus->set_is_roundtrip(delta_bus.is_roundtrip());
+            for (const auto& name : delta_bus.names_of_stops()) {
+                bus->add_stop_ids(get_stop_id(name));
+            }
+        }
+
+        // Готовые ответы: из дельты для затронутых, из базы для остальных.
+        // Если какого-то ответа нет, ответы не используются вовсе
+        const auto& old_answers = base_->answers();
+        bool complete = old_answers.stops_size() == transport_base.stops_size()
+            && old_answers.buses_size() == transport_base.buses_size()
+            && delta.answers().stops_size() == delta.answered_stops_size()
+            && delta.answers().buses_size() == delta.answered_buses_size();
+        auto& answers = *CreateMessage<proto_catalogue::AnswerFragments>(*arena_);
+        if (complete) {
+            std::unordered_map<std::string, int> delta_stop_answers;
+            for (int i = 0; i < delta.answered_stops_size(); ++i) {
+                delta_stop_answers.emplace(delta.answered_stops(i), i);
+            }
+            std::unordered_map<std::string, int> delta_bus_answers;
+            for (int i = 0; i < delta.answered_buses_size(); ++i) {
+                delta_bus_answers.emplace(delta.answered_buses(i), i);
+            }
+            for (int i = 0; complete && i < result.stops_size(); ++i) {
+                if (const auto it = delta_stop_answers.find(result.stops(i).stop_name()); it != delta_stop_answers.end()) {
+                    *answers.add_stops() = delta.answers().stops(it->second);
+                }
+                else if (old_stop_ids[i] >= 0) {
+                    *answers.add_stops() = old_answers.stops(old_stop_ids[i]);
+                }
+                else {
+                    complete = false;
+                }
+            }
+            for (int i = 0; complete && i < result.buses_size(); ++i) {
+                if (const auto it = delta_bus_answers.find(result.buses(i).bus_name()); it != delta_bus_answers.end()) {
+                    *answers.add_buses() = delta.answers().buses(it->second);
+                }
+                else if (old_bus_ids[i] >= 0) {
+                    *answers.add_buses() = old_answers.buses(old_bus_ids[i]);
+                }
+                else {
+                    complete = false;
+                }
+            }
+            // Изменившаяся карта печатается заново из map_ren
+            if (!delta.has_map_ren()) {
+                answers.set_map(old_answers.map());
+            }
+        }
+        if (complete) {
+            base_->mutable_answers()->Swap(&answers);
+        }
+        else {
+            base_->clear_answers();
+        }
+
+        if (delta.has_map_ren()) {
+            *base_->mutable_map_ren() = delta.map_ren();
+        }
+        if (delta.has_router_set()) {
+            *base_->mutable_router_set() = delta.router_set();
+        }
+        base_->mutable_transport_base()->Swap(&result);
     }
 
     void Serialization::DeserializeDistanceFromTo() {
-        for (int i = 0; i < base_.transport_base().distance_from_to_size(); ++i) {
-            LoadDistanceFromTo(base_.transport_base().distance_from_to(i));
+        if (base_->transport_base().schema_version() >= 3) {
+            // Раздел расстояний мог быть не загружен
+            if (base_->transport_base().distance_columns().empty()) {
+                return;
+            }
+            const auto distances = base_codec::DecodeDistances(base_->transport_base().distance_columns());
+            transport_catalogue_.ReserveDistances(distances.size());
+            for (const auto& [from, to, distance] : distances) {
+                transport_catalogue_.SetDistance(stops_by_id_.at(from), stops_by_id_.at(to), distance);
+            }
+            return;
+        }
+        if (base_->transport_base().schema_version() >= 2) {
+            const auto& table = base_->transport_base().distance_table();
+            if (table.to_ids_size() != table.from_ids_size() || table.distances_size() != table.from_ids_size()) {
+                throw std::runtime_error("Corrupted distance table in the base");
+            }
+            transport_catalogue_.ReserveDistances(table.from_ids_size());
+            for (int i = 0; i < table.from_ids_size(); ++i) {
+                transport_catalogue_.SetDistance(stops_by_id_.at(table.from_ids(i)), stops_by_id_.at(table.to_ids(i)), table.distances(i));
+            }
+            return;
+        }
+        transport_catalogue_.ReserveDistances(base_->transport_base().distance_from_to_size());
+        for (int i = 0; i < base_->transport_base().distance_from_to_size(); ++i) {
+            LoadDistanceFromTo(base_->transport_base().distance_from_to(i));
         }
     }
 
     void Serialization::DeserializeBuses() {
-        for (int i = 0; i < base_.transport_base().buses_size(); ++i) {
-            LoadBus(base_.transport_base().buses(i));
+        // Остановки автобусов находятся параллельно, а в справочник автобусы
+        // добавляются по порядку: по нему назначаются их номера
+        auto& buses = *base_->mutable_transport_base()->mutable_buses();
+        std::vector<domain::Bus> loaded(buses.size());
+        thread_pool::ParallelFor(loaded.size(), [&](size_t i) {
+            loaded[i] = LoadBus(buses[static_cast<int>(i)]);
+        });
+        for (auto& bus : loaded) {
+            transport_catalogue_.AddRoute(std::move(bus));
         }
     }
 
     std::string Serialization::DeserializeMapRenderer() {
-        return base_.map_ren().str_of_result_map_render();
+        return base_->map_ren().str_of_result_map_render();
     }
 
     double Serialization::DeserializeRouterSetVelosity() {
-        return base_.router_set().bus_velocity();
+        return base_->router_set().bus_velocity();
     }
 
    int Serialization::DeserializeRouterSetTime() {
-       return base_.router_set().bus_wait_time();
+       return base_->router_set().bus_wait_time();
+    }
+
+    namespace {
+        void FillAnswerFragment(proto_catalogue::AnswerFragment& fragment, AnswerFragment pretty, AnswerFragment compact) {
+            fragment.set_pretty(pretty.text.data(), pretty.text.size());
+            fragment.set_pretty_id_pos(static_cast<uint32_t>(pretty.id_pos));
+            fragment.set_compact(compact.text.data(), compact.text.size());
+            fragment.set_compact_id_pos(static_cast<uint32_t>(compact.id_pos));
+        }
+
+        AnswerFragment GetAnswerFragment(const proto_catalogue::AnswerFragment& fragment, bool compact) {
+            return compact
+                ? AnswerFragment{ fragment.compact(), fragment.compact_id_pos() }
+                : AnswerFragment{ fragment.pretty(), fragment.pretty_id_pos() };
+        }
+    }
+
+    // Вне Serialize ответы копятся в base_, внутри - пишутся кусками по CHUNK_SIZE
+    void Serialization::AddStopAnswer(AnswerFragment pretty, AnswerFragment compact) {
+        if (!writer_) {
+            FillAnswerFragment(*base_->mutable_answers()->add_stops(), pretty, compact);
+            return;
+        }
+        if (pending_answers_.buses_size() > 0) {
+            FlushAnswers();
+        }
+        FillAnswerFragment(*pending_answers_.add_stops(), pretty, compact);
+        if (pending_answers_.stops_size() + pending_answers_.buses_size() >= CHUNK_SIZE) {
+            FlushAnswers();
+        }
+    }
+
+    void Serialization::AddBusAnswer(AnswerFragment pretty, AnswerFragment compact) {
+        if (!writer_) {
+            FillAnswerFragment(*base_->mutable_answers()->add_buses(), pretty, compact);
+            return;
+        }
+        // Ответы остановок и автобусов - разные разделы, в одном куске их не смешиваем
+        if (pending_answers_.stops_size() > 0) {
+            FlushAnswers();
+        }
+        FillAnswerFragment(*pending_answers_.add_buses(), pretty, compact);
+        if (pending_answers_.stops_size() + pending_answers_.buses_size() >= CHUNK_SIZE) {
+            FlushAnswers();
+        }
+    }
+
+    void Serialization::SerializeMapAnswer(std::string_view escaped_map) {
+        if (!writer_) {
+            base_->mutable_answers()->set_map(escaped_map.data(), escaped_map.size());
+            return;
+        }
+        FlushAnswers();
+        pending_answers_.set_map(escaped_map.data(), escaped_map.size());
+        FlushAnswers();
+    }
+
+    void Serialization::FlushAnswers() {
+        if (pending_answers_.ByteSizeLong() == 0) {
+            return;
+        }
+        const uint32_t section = pending_answers_.stops_size() > 0 ? SECTION_STOP_ANSWERS
+            : pending_answers_.buses_size() > 0 ? SECTION_BUS_ANSWERS
+            : SECTION_MAP_ANSWER;
+        writer_->WriteField(ANSWERS_FIELD, pending_answers_, section);
+        pending_answers_.Clear();
+    }
+
+    bool Serialization::HasAnswerFragments() const {
+        return base_->has_answers();
+    }
+
+    // Ответам можно верить, только если они есть для каждой загруженной
+    // остановки или автобуса
+    std::optional<AnswerFragment> Serialization::GetStopAnswer(size_t stop_id, bool compact) const {
+        const auto& stops = base_->answers().stops();
+        if (stops.size() != base_->transport_base().stops_size() || stop_id >= static_cast<size_t>(stops.size())) {
+            return std::nullopt;
+        }
+        return GetAnswerFragment(stops[static_cast<int>(stop_id)], compact);
+    }
+
+    std::optional<AnswerFragment> Serialization::GetBusAnswer(size_t bus_id, bool compact) const {
+        const auto& buses = base_->answers().buses();
+        if (buses.size() != base_->transport_base().buses_size() || bus_id >= static_cast<size_t>(buses.size())) {
+            return std::nullopt;
+        }
+        return GetAnswerFragment(buses[static_cast<int>(bus_id)], compact);
+    }
+
+    std::optional<std::string_view> Serialization::GetMapAnswer() const {
+        if (base_->answers().map().empty()) {
+            return std::nullopt;
+        }
+        return base_->answers().map();
     }
 }
\ No newline at end of file
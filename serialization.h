@@ -1,24 +1,92 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <map>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <optional>
+#include <vector>
 
 #include "domain.h"
 #include "transport_catalogue.h"
+#include "stop_order.h"
 
 #include "transport_catalogue.pb.h"
 #include "map_renderer.pb.h"
 
 namespace serialize {
+	// Готовый ответ без значения request_id и позиция, куда его вставить
+	struct AnswerFragment {
+		std::string_view text;
+		size_t id_pos = 0;
+	};
+
+	enum class BaseFormat {
+		PROTOBUF,
+		// Плоский образ catalogue_image, используемый прямо из отображённого файла
+		FLAT,
+	};
+
+	// Разделы базы, загружаемые по отдельности (битовая маска). Остановки
+	// и настройки маршрутизатора нужны всегда и загружаются всегда
+	enum BaseSection : uint32_t {
+		SECTION_DISTANCES = 1u << 0,
+		SECTION_BUSES = 1u << 1,
+		SECTION_MAP = 1u << 2,
+		SECTION_STOP_ANSWERS = 1u << 3,
+		SECTION_BUS_ANSWERS = 1u << 4,
+		SECTION_MAP_ANSWER = 1u << 5,
+		ALL_SECTIONS = (1u << 6) - 1,
+	};
+
+	// По разделам, имеющимся в базе, выбирает, какие загрузить
+	using SectionChooser = std::function<uint32_t(uint32_t available)>;
+
+	// Получает названия остановок и автобусов, чьи готовые ответы могли измениться
+	using DeltaAnswersWriter = std::function<void(const std::vector<std::string_view>& stops,
+		const std::vector<std::string_view>& buses)>;
+
 	class Serialization {
 	public:
 		Serialization(transport_db::TransportCatalogue& transport_catalogue);
+		~Serialization();
 
 		void SetSetting(const std::filesystem::path& path_to_base);
-		void Serialize(transport_db::TransportCatalogue& cat);
-		void DeserializeCatalogue(transport_db::TransportCatalogue& cat);
+		// Формат базы определяется по заголовку файла
+		BaseFormat DetectFormat() const;
+		// Сжимать ли записываемую базу блочным LZ (base_codec::CompressedWriter);
+		// сжатая база распознаётся при чтении по заголовку
+		void SetCompression(bool compress);
+		// Нумерация остановок записываемой базы: она сохраняется в заголовке
+		// вместе с номером каждой остановки во входе make_base
+		void SetStopOrder(stop_order::StopOrder order, stop_order::Permutation input_positions);
+		// Файл изменений make_delta, применяемый к базе при загрузке; пустой путь - без него.
+		// С дельтой база загружается целиком
+		void SetDelta(const std::filesystem::path& delta_path);
+		// Записывает в delta_path отличия справочника от базы, заданной SetSetting:
+		// остановки, расстояния и автобусы, карту, если она изменилась, и настройки
+		// маршрутизатора. Готовые ответы затронутых остановок и автобусов добавляются
+		// из write_answers (AddStopAnswer, AddBusAnswer) в порядке переданных ему
+		// названий. Готовый ответ Map в дельту не пишется: при изменении карты он
+		// печатается из неё при загрузке
+		void SerializeDelta(const std::filesystem::path& delta_path, const DeltaAnswersWriter& write_answers);
+		// Пишет базу по частям, не собирая её целиком в памяти. write_answers
+		// вызывается посреди записи: добавленные из него готовые ответы
+		// (AddStopAnswer, AddBusAnswer, SerializeMapAnswer) сразу уходят в файл
+		void Serialize(const std::function<void()>& write_answers = {});
+		// Те же шаги записи по отдельности, чтобы между ними выполнять другую
+		// работу: BeginSerialize открывает запись, SerializeCatalogue пишет
+		// остановки, расстояния и автобусы, затем добавляются готовые ответы,
+		// FinishSerialize дописывает карту, настройки маршрутизатора и оглавление
+		void BeginSerialize();
+		void SerializeCatalogue();
+		void FinishSerialize();
+		// Базы с оглавлением загружаются частично - разделы выбирает
+		// choose_sections; без него и у баз без оглавления загружается всё
+		void DeserializeCatalogue(const SectionChooser& choose_sections = {});
 		std::string DeserializeMapRenderer();
 		void SerializeMapRender(std::string map);
 		void SerializeRouterSetVelosity(std::map <std::string, double> router_settings_velosity);
@@ -26,10 +94,33 @@ namespace serialize {
 		double DeserializeRouterSetVelosity();
 		int DeserializeRouterSetTime();
 
+		void AddStopAnswer(AnswerFragment pretty, AnswerFragment compact);
+		void AddBusAnswer(AnswerFragment pretty, AnswerFragment compact);
+		void SerializeMapAnswer(std::string_view escaped_map);
+		// Готовые ответы есть для каждой остановки и автобуса базы;
+		// в базах, записанных до их появления, их нет. Getters возвращают
+		// nullopt, если раздел с такими ответами не загружен
+		bool HasAnswerFragments() const;
+		std::optional<AnswerFragment> GetStopAnswer(size_t stop_id, bool compact) const;
+		std::optional<AnswerFragment> GetBusAnswer(size_t bus_id, bool compact) const;
+		std::optional<std::string_view> GetMapAnswer() const;
+
 	private:
-        proto_catalogue::Stop SaveStop(const domain::Stop& stop) const;
-		proto_catalogue::DistanceFromTo SaveDistanceFromTo(domain::Stop* from, domain::Stop* to, size_t dist) const;
-		proto_catalogue::Bus SaveBus(const domain::Bus& bus) const;
+        // Версия схемы, в которой пишется база: 2 - ссылки на остановки по номерам,
+        // 3 - координаты и расстояния столбцами base_codec
+        static constexpr uint32_t SCHEMA_VERSION = 3;
+        // Сколько остановок, автобусов или ответов пишется одним куском
+        static constexpr int CHUNK_SIZE = 4096;
+
+        class BaseWriter;
+
+        std::filesystem::path GetTempPath() const;
+        // Отпечаток загруженной базы, с которым сверяется дельта
+        uint64_t GetBaseFingerprint() const;
+
+        // Заполняют сообщение на месте, в куске записываемой базы
+        void SaveStop(const domain::Stop& stop, proto_catalogue::Stop& proto_stop) const;
+		void SaveBus(const domain::Bus& bus, proto_catalogue::Bus& proto_bus) const;
 
         void SerializeStops();
 
@@ -37,11 +128,25 @@ namespace serialize {
 
         void SerializeBuses();
 
-        void LoadStop(const proto_catalogue::Stop& stop);
+		void FlushAnswers();
+
+        // Названия забираются из base_ перемещением: после загрузки они там не нужны
+        void LoadStop(proto_catalogue::Stop& stop, geo::Coordinates coordinates);
 		void LoadDistanceFromTo(const proto_catalogue::DistanceFromTo& distance_from_to);
-    void LoadBus(const proto_catalogue::Bus& bus);
+    domain::Bus LoadBus(proto_catalogue::Bus& bus);
+
+		// Разбирает базу в base_: куски транспортной базы и готовых ответов
+		// разбираются параллельно и склеиваются по порядку
+		void ParseBase(std::string_view data);
 
     void DeserializeStops();
+		// Координаты остановок базы по номерам при любой версии схемы
+		std::vector<geo::Coordinates> DecodeStopCoordinates() const;
+		// Расстояния базы по названиям остановок при любой версии схемы
+		std::map<std::pair<std::string, std::string>, uint64_t> DecodeNamedDistances() const;
+		// Применяет дельту к разобранной базе: справочник переписывается
+		// в текущей схеме SCHEMA_VERSION, готовые ответы - по новым номерам
+		void ApplyDelta();
 
 	void DeserializeDistanceFromTo();
 
@@ -49,7 +154,19 @@ namespace serialize {
 
 		std::filesystem::path path_;
 		transport_db::TransportCatalogue& transport_catalogue_;
-		mutable proto_catalogue::TransportCatalogue base_;
+		// base_ и куски, из которых он собирается при разборе, живут на арене:
+		// сообщения и строки базы размещаются её блоками и освобождаются разом
+		std::unique_ptr<google::protobuf::Arena> arena_;
+		proto_catalogue::TransportCatalogue* base_;
+		bool compress_ = false;
+		stop_order::StopOrder stop_order_ = stop_order::StopOrder::INPUT;
+		stop_order::Permutation stop_input_positions_;
+		std::filesystem::path delta_path_;
+		// Открытая запись базы и ещё не записанные готовые ответы
+		std::unique_ptr<BaseWriter> writer_;
+		proto_catalogue::AnswerFragments pending_answers_;
+		// Загруженные остановки по номерам в базе
+		std::vector<domain::Stop*> stops_by_id_;
 	};
 
 }
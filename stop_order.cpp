@@ -0,0 +1,126 @@
+#include "stop_order.h"
+
+#include <algorithm>
+#include <numeric>
+#include <queue>
+#include <utility>
+
+namespace stop_order {
+
+    namespace {
+        // Сторона решётки, на которую ложатся координаты для кривой Гильберта
+        constexpr uint32_t HILBERT_SIDE = 1u << 16;
+
+        // Номер клетки (x, y) вдоль кривой Гильберта
+        uint64_t HilbertIndex(uint32_t x, uint32_t y) {
+            uint64_t index = 0;
+            for (uint32_t half = HILBERT_SIDE / 2; half > 0; half /= 2) {
+                const uint32_t rx = (x & half) > 0 ? 1 : 0;
+                const uint32_t ry = (y & half) > 0 ? 1 : 0;
+                index += uint64_t{ half } * half * ((3 * rx) ^ ry);
+                // Поворот четверти, чтобы кривая в ней начиналась там, где кончилась в предыдущей
+                if (ry == 0) {
+                    if (rx == 1) {
+                        x = HILBERT_SIDE - 1 - x;
+                        y = HILBERT_SIDE - 1 - y;
+                    }
+                    std::swap(x, y);
+                }
+            }
+            return index;
+        }
+
+        uint32_t ToGrid(double value, double min, double max) {
+            if (!(max > min)) {
+                return 0;
+            }
+            const double cell = (value - min) / (max - min) * (HILBERT_SIDE - 1);
+            return static_cast<uint32_t>(std::clamp(cell, 0.0, static_cast<double>(HILBERT_SIDE - 1)));
+        }
+
+        Permutation SortByKey(const std::vector<uint64_t>& keys) {
+            Permutation order(keys.size());
+            std::iota(order.begin(), order.end(), 0u);
+            std::stable_sort(order.begin(), order.end(), [&keys](uint32_t lhs, uint32_t rhs) {
+                return keys[lhs] < keys[rhs];
+            });
+            return order;
+        }
+    }
+
+    Permutation HilbertOrder(const std::vector<geo::Coordinates>& coordinates) {
+        if (coordinates.empty()) {
+            return {};
+        }
+        double min_lat = coordinates.front().lat;
+        double max_lat = min_lat;
+        double min_lng = coordinates.front().lng;
+        double max_lng = min_lng;
+        for (const auto& point : coordinates) {
+            min_lat = std::min(min_lat, point.lat);
+            max_lat = std::max(max_lat, point.lat);
+            min_lng = std::min(min_lng, point.lng);
+            max_lng = std::max(max_lng, point.lng);
+        }
+        std::vector<uint64_t> keys;
+        keys.reserve(coordinates.size());
+        for (const auto& point : coordinates) {
+            keys.push_back(HilbertIndex(ToGrid(point.lng, min_lng, max_lng), ToGrid(point.lat, min_lat, max_lat)));
+        }
+        return SortByKey(keys);
+    }
+
+    // Обход в ширину из вершины наименьшей степени, соседи - по возрастанию
+    // степени; каждая компонента связности обходится отдельно, затем порядок
+    // обращается. Соседние на маршрутах остановки получают близкие номера
+    Permutation ReverseCuthillMcKeeOrder(size_t stop_count, const std::vector<std::vector<uint32_t>>& routes) {
+        std::vector<std::vector<uint32_t>> neighbours(stop_count);
+        for (const auto& route : routes) {
+            for (size_t i = 1; i < route.size(); ++i) {
+                if (route[i - 1] != route[i]) {
+                    neighbours[route[i - 1]].push_back(route[i]);
+                    neighbours[route[i]].push_back(route[i - 1]);
+                }
+            }
+        }
+        std::vector<uint64_t> degrees(stop_count);
+        for (size_t stop = 0; stop < stop_count; ++stop) {
+            auto& adjacent = neighbours[stop];
+            std::sort(adjacent.begin(), adjacent.end());
+            adjacent.erase(std::unique(adjacent.begin(), adjacent.end()), adjacent.end());
+            degrees[stop] = adjacent.size();
+        }
+        auto by_degree = [&degrees](uint32_t lhs, uint32_t rhs) {
+            return std::pair{ degrees[lhs], lhs } < std::pair{ degrees[rhs], rhs };
+        };
+        for (auto& adjacent : neighbours) {
+            std::sort(adjacent.begin(), adjacent.end(), by_degree);
+        }
+
+        Permutation order;
+        order.reserve(stop_count);
+        std::vector<bool> visited(stop_count, false);
+        std::queue<uint32_t> queue;
+        for (const uint32_t start : SortByKey(degrees)) {
+            if (visited[start]) {
+                continue;
+            }
+            visited[start] = true;
+            queue.push(start);
+            while (!queue.empty()) {
+                const uint32_t stop = queue.front();
+                queue.pop();
+                order.push_back(stop);
+                for (const uint32_t next : neighbours[stop]) {
+                    if (!visited[next]) {
+                        visited[next] = true;
+                        queue.push(next);
+                    }
+                }
+            }
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+} // namespace stop_order
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "geo.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace stop_order {
+
+    // Нумерация остановок в make_base. Номер остановки - её место в справочнике,
+    // вершина графа маршрутизатора и строка его таблиц, поэтому нумерация,
+    // в которой соседние остановки получают близкие номера, улучшает
+    // локальность обращений к памяти при маршрутизации и отрисовке
+    enum class StopOrder : uint32_t {
+        // В порядке входного документа
+        INPUT = 0,
+        // Вдоль кривой Гильберта по координатам
+        HILBERT = 1,
+        // Обратный порядок Катхилла - Макки по графу соседства на маршрутах
+        RCM = 2,
+    };
+
+    // order[i] - номер во входе остановки, получающей номер i.
+    // Остановки с равными ключами сохраняют порядок входа
+    using Permutation = std::vector<uint32_t>;
+
+    Permutation HilbertOrder(const std::vector<geo::Coordinates>& coordinates);
+    // routes - остановки каждого маршрута по номерам во входе
+    Permutation ReverseCuthillMcKeeOrder(size_t stop_count, const std::vector<std::vector<uint32_t>>& routes);
+
+} // namespace stop_order
@@ -0,0 +1,65 @@
+# Прогоняет один сценарий из tests/<сценарий>: файлы шагов NN_<режим>.<расширение>
+# (или NN_<режим>--<флаг>.<расширение> для transport_catalogue <режим> --<флаг>)
+# по порядку подаются на вход transport_catalogue <режим>, запущенного в WORK_DIR
+# (пути к базам в сценариях относительные), вывод последнего шага сравнивается
+# с expected.txt. Если вместо него лежит expected_error.txt, последний шаг
+# должен завершиться ошибкой, в тексте которой есть первая строка этого файла.
+# Шаг serve читает кадры query_protocol (длина в байтах, перевод строки, JSON):
+# первый кадр - настройки базы, каждый следующий - запрос.
+#
+#   cmake -DBINARY=<transport_catalogue> -DCASE_DIR=<сценарий> -DWORK_DIR=<каталог> -P run_case.cmake
+cmake_minimum_required(VERSION 3.10)
+
+foreach(variable BINARY CASE_DIR WORK_DIR)
+    if(NOT DEFINED ${variable})
+        message(FATAL_ERROR "${variable} is not set")
+    endif()
+endforeach()
+
+file(GLOB steps RELATIVE "${CASE_DIR}" "${CASE_DIR}/[0-9][0-9]_*")
+list(SORT steps)
+if(NOT steps)
+    message(FATAL_ERROR "No steps in ${CASE_DIR}")
+endif()
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+list(LENGTH steps step_count)
+math(EXPR last_step "${step_count} - 1")
+list(GET steps ${last_step} last)
+
+foreach(step ${steps})
+    string(REGEX MATCH "^[0-9][0-9]_([a-z_]+)(--[a-z_]+)?\\." matched "${step}")
+    set(mode "${CMAKE_MATCH_1}")
+    set(flag "${CMAKE_MATCH_2}")
+    execute_process(
+        COMMAND "${BINARY}" ${mode} ${flag}
+        INPUT_FILE "${CASE_DIR}/${step}"
+        OUTPUT_FILE "${WORK_DIR}/${step}.out"
+        ERROR_VARIABLE errors
+        RESULT_VARIABLE result
+        WORKING_DIRECTORY "${WORK_DIR}")
+    if(step STREQUAL last AND EXISTS "${CASE_DIR}/expected_error.txt")
+        file(STRINGS "${CASE_DIR}/expected_error.txt" expected_error LIMIT_COUNT 1)
+        if(result EQUAL 0)
+            message(FATAL_ERROR "${step}: ${mode} succeeded, expected an error")
+        endif()
+        string(FIND "${errors}" "${expected_error}" found)
+        if(found EQUAL -1)
+            message(FATAL_ERROR "${step}: expected '${expected_error}' in\n${errors}")
+        endif()
+        return()
+    endif()
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${step}: ${mode} failed (${result})\n${errors}")
+    endif()
+    set(actual "${WORK_DIR}/${step}.out")
+endforeach()
+
+execute_process(
+    COMMAND "${CMAKE_COMMAND}" -E compare_files "${actual}" "${CASE_DIR}/expected.txt"
+    RESULT_VARIABLE differs)
+if(differs)
+    message(FATAL_ERROR "${actual} differs from ${CASE_DIR}/expected.txt")
+endif()
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace thread_pool {
+
+    class ThreadPool {
+    public:
+        explicit ThreadPool(size_t thread_count = DefaultThreadCount()) {
+            workers_.reserve(thread_count);
+            for (size_t i = 0; i < thread_count; ++i) {
+                workers_.emplace_back([this] {
+                    WorkerLoop();
+                });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Дожидается выполнения всех поставленных задач
+        ~ThreadPool() {
+            {
+                std::lock_guard lock(mutex_);
+                stopped_ = true;
+            }
+            has_tasks_.notify_all();
+            for (auto& worker : workers_) {
+                worker.join();
+            }
+        }
+
+        template <typename Task>
+        auto Submit(Task task) -> std::future<std::invoke_result_t<Task>> {
+            using Result = std::invoke_result_t<Task>;
+            auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+            std::future<Result> result = packaged->get_future();
+            {
+                std::lock_guard lock(mutex_);
+                tasks_.emplace([packaged] {
+                    (*packaged)();
+                });
+            }
+            has_tasks_.notify_one();
+            return result;
+        }
+
+        size_t GetThreadCount() const {
+            return workers_.size();
+        }
+
+        static size_t DefaultThreadCount() {
+            return std::max(1u, std::thread::hardware_concurrency());
+        }
+
+    private:
+        void WorkerLoop() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock lock(mutex_);
+                    has_tasks_.wait(lock, [this] {
+                        return stopped_ || !tasks_.empty();
+                    });
+                    if (tasks_.empty()) {
+                        return;
+                    }
+                    task = std::move(tasks_.front());
+                    tasks_.pop();
+                }
+                task();
+            }
+        }
+
+        std::vector<std::thread> workers_;
+        std::queue<std::function<void()>> tasks_;
+        std::mutex mutex_;
+        std::condition_variable has_tasks_;
+        bool stopped_ = false;
+    };
+
+    // Вызывает task(i) для каждого i из [0, count) в thread_count потоках.
+    // Потоки берут индексы небольшими порциями, поэтому неравные по времени
+    // задачи распределяются сами. Исключение из задачи пробрасывается наружу
+    // после завершения всех потоков
+    template <typename Task>
+    void ParallelFor(size_t count, Task task, size_t thread_count = ThreadPool::DefaultThreadCount()) {
+        thread_count = std::min(thread_count, count);
+        if (thread_count <= 1) {
+            for (size_t i = 0; i < count; ++i) {
+                task(i);
+            }
+            return;
+        }
+        const size_t portion = std::max<size_t>(1, count / (thread_count * 8));
+        std::atomic<size_t> next{ 0 };
+        auto work = [&] {
+            for (size_t begin = next.fetch_add(portion); begin < count; begin = next.fetch_add(portion)) {
+                const size_t end = std::min(count, begin + portion);
+                for (size_t i = begin; i < end; ++i) {
+                    task(i);
+                }
+            }
+        };
+        std::vector<std::future<void>> workers;
+        workers.reserve(thread_count - 1);
+        for (size_t i = 1; i < thread_count; ++i) {
+            workers.push_back(std::async(std::launch::async, work));
+        }
+        std::exception_ptr error;
+        try {
+            work();
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        for (auto& worker : workers) {
+            try {
+                worker.get();
+            }
+            catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Задачи с явными зависимостями. Задача ставится в пул, как только
+    // выполнены все задачи, от которых она зависит, поэтому независимые
+    // ветви графа идут параллельно. Зависеть можно только от добавленных
+    // раньше задач - циклов не бывает
+    class TaskGraph {
+    public:
+        using TaskId = size_t;
+
+        TaskId Add(std::function<void()> task, const std::vector<TaskId>& dependencies = {}) {
+            const TaskId id = nodes_.size();
+            for (const TaskId dependency : dependencies) {
+                if (dependency >= id) {
+                    throw std::invalid_argument("Task depends on a task added after it");
+                }
+            }
+            Node& node = nodes_.emplace_back();
+            node.task = std::move(task);
+            node.dependency_count = dependencies.size();
+            for (const TaskId dependency : dependencies) {
+                nodes_[dependency].dependents.push_back(id);
+            }
+            return id;
+        }
+
+        // Выполняет граф в пуле и дожидается всех задач. После первого
+        // исключения новые задачи не запускаются, а исключение
+        // пробрасывается, когда завершатся уже начатые
+        void Run(ThreadPool& pool) {
+            std::mutex mutex;
+            std::condition_variable all_done;
+            std::vector<size_t> waiting(nodes_.size());
+            size_t finished = 0;
+            std::exception_ptr error;
+
+            std::function<void(TaskId)> start = [&](TaskId id) {
+                pool.Submit([&, id] {
+                    bool failed = false;
+                    {
+                        std::lock_guard lock(mutex);
+                        failed = static_cast<bool>(error);
+                    }
+                    if (!failed) {
+                        try {
+                            nodes_[id].task();
+                        }
+                        catch (...) {
+                            std::lock_guard lock(mutex);
+                            if (!error) {
+                                error = std::current_exception();
+                            }
+                        }
+                    }
+                    // Запуск зависимых и оповещение под замком: Run не вернётся,
+                    // пока рабочий поток ещё обращается к его переменным
+                    std::lock_guard lock(mutex);
+                    for (const TaskId dependent : nodes_[id].dependents) {
+                        if (--waiting[dependent] == 0) {
+                            start(dependent);
+                        }
+                    }
+                    if (++finished == nodes_.size()) {
+                        all_done.notify_all();
+                    }
+                });
+            };
+
+            std::unique_lock lock(mutex);
+            for (TaskId id = 0; id < nodes_.size(); ++id) {
+                waiting[id] = nodes_[id].dependency_count;
+            }
+            for (TaskId id = 0; id < nodes_.size(); ++id) {
+                if (waiting[id] == 0) {
+                    start(id);
+                }
+            }
+            all_done.wait(lock, [&] {
+                return finished == nodes_.size();
+            });
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+    private:
+        struct Node {
+            std::function<void()> task;
+            size_t dependency_count = 0;
+            std::vector<TaskId> dependents;
+        };
+
+        std::vector<Node> nodes_;
+    };
+
+} // namespace thread_pool
@@ -5,21 +5,31 @@ namespace transport_db
     TransportCatalogue::TransportCatalogue()
     {}
 
-    void TransportCatalogue::AddStop(geo::Coordinates coordinates, const std::string& name) {
-        all_stops_.push_back(std::move(domain::Stop(all_stops_.size(), coordinates, name)));
+    domain::Stop* TransportCatalogue::AddStop(geo::Coordinates coordinates, std::string name) {
+        all_stops_.emplace_back(all_stops_.size(), coordinates, std::move(name));
         domain::Stop* stop = &(all_stops_.back());
         std::string_view stop_view{ (*stop).name };
         all_stops_map_[stop_view] = stop;
+        return stop;
     }
 
     void TransportCatalogue::AddRoute(const domain::Bus& route)
+    {
+        if (all_buses_map_.count(route.bus_number) == 0)
+        {
+            AddRoute(domain::Bus(route));
+        }
+    }
+
+    void TransportCatalogue::AddRoute(domain::Bus&& route)
     {
         if (all_buses_map_.count(route.bus_number) == 0)
         {
             auto& ref = all_buses_.emplace_back(std::move(route));
+            ref.id = all_buses_.size() - 1;
             all_buses_map_.insert({ std::string_view(ref.bus_number), &ref });
-            for (size_t i = 0; i < route.stops.size(); ++i) {
-                stop_to_bus_map_[route.stops[i]].insert(&ref);
+            for (size_t i = 0; i < ref.stops.size(); ++i) {
+                stop_to_bus_map_[ref.stops[i]].insert(&ref);
             }
         }
     }
@@ -34,10 +44,10 @@ namespace transport_db
     BusInfo TransportCatalogue::GetBusInfo(const std::string_view route)
     {
         BusInfo bus_info;
-        if (all_buses_map_.count(route))
+        if (const auto it = all_buses_map_.find(route); it != all_buses_map_.end())
         {
             bus_info.bus_number_ = route;
-            auto& Bus = all_buses_map_[route];
+            const auto& Bus = it->second;
             std::vector<domain::Stop*> tmp = Bus->stops;
             bus_info.stops_count_ = static_cast<int>(Bus->stops.size());
             std::sort(tmp.begin(), tmp.end());
@@ -85,7 +95,7 @@ namespace transport_db
         }
     }
 
-    std::unordered_map<std::pair<domain::Stop*, domain::Stop*>, size_t, PointersHasher> TransportCatalogue::GetStopsFromTo() 
+    const std::unordered_map<std::pair<domain::Stop*, domain::Stop*>, size_t, PointersHasher>& TransportCatalogue::GetStopsFromTo() const
     {
         return distances_;
     }
@@ -122,14 +132,32 @@ namespace transport_db
         }
     }
 
-    std::deque<domain::Bus> TransportCatalogue::GetAllBuses() {
+    const std::deque<domain::Bus>& TransportCatalogue::GetAllBuses() const {
         return all_buses_;
     }
 
-    std::deque<domain::Stop> TransportCatalogue::GetAllStops() {
+    const std::deque<domain::Stop>& TransportCatalogue::GetAllStops() const {
         return all_stops_;
     }
 
+    void TransportCatalogue::ReserveStops(size_t stop_count) {
+        all_stops_map_.reserve(stop_count);
+        stop_to_bus_map_.reserve(stop_count);
+    }
+
+    void TransportCatalogue::ReserveBuses(size_t bus_count) {
+        all_buses_map_.reserve(bus_count);
+    }
+
+    void TransportCatalogue::ReserveDistances(size_t distance_count) {
+        distances_.reserve(distance_count);
+    }
+
+    const domain::Stop& TransportCatalogue::GetStopById(size_t id) const
+    {
+        return all_stops_.at(id);
+    }
+
     domain::Bus* TransportCatalogue::GetRouteByName(std::string_view bus_name)
     {
         if (all_buses_map_.count(bus_name) == 0)
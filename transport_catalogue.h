@@ -57,27 +57,38 @@ namespace transport_db
         TransportCatalogue();
         virtual ~TransportCatalogue() = default;
 
-        void AddStop(geo::Coordinates coordinates, const std::string& name);
+        domain::Stop* AddStop(geo::Coordinates coordinates, std::string name);
         void AddRoute(const domain::Bus& route);
+        void AddRoute(domain::Bus&& route);
         void AddStopToBusMap(const std::string_view route);
 
         std::string_view GetStopName(const domain::Stop* stop_ptr);
         std::string_view GetStopName(const domain::Stop stop);
-        std::deque<domain::Stop> GetAllStops();
+        const std::deque<domain::Stop>& GetAllStops() const;
         StopInfo GetStopInfo(std::string_view stop_name);
        
         std::string_view GetBusName(const domain::Bus* route_ptr);
         std::string_view GetBusName(const domain::Bus route);
         BusInfo GetBusInfo(const std::string_view route);
-        std::deque<domain::Bus> GetAllBuses();
+        const std::deque<domain::Bus>& GetAllBuses() const;
 
+        // Резервируют таблицы под известное заранее число записей, чтобы загрузка
+        // не перестраивала их по ходу. Расстояния резервируются отдельно:
+        // их таблица заполняется одновременно с автобусами
+        void ReserveStops(size_t stop_count);
+        void ReserveBuses(size_t bus_count);
+        void ReserveDistances(size_t distance_count);
+
+        // Меняет только таблицу расстояний, а AddRoute - только таблицы автобусов:
+        // при загрузке базы они вызываются из разных потоков одновременно
         void SetDistance(domain::Stop* stop_from, domain::Stop* stop_to, size_t dist);
         size_t GetDistance(domain::Stop* stop_from, domain::Stop* stop_to);
         size_t GetDistanceDirectly(domain::Stop* stop_from, domain::Stop* stop_to);
 
         domain::Stop* GetStopByName(std::string_view stop_name);
+        const domain::Stop& GetStopById(size_t id) const;
         domain::Bus* GetRouteByName(std::string_view bus_name);
-        std::unordered_map<std::pair<domain::Stop*, domain::Stop*>, size_t, PointersHasher> GetStopsFromTo();
+        const std::unordered_map<std::pair<domain::Stop*, domain::Stop*>, size_t, PointersHasher>& GetStopsFromTo() const;
 
 
     private: